@@ -0,0 +1,349 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+// Stress test of IPv4 fragmentation and reassembly: several threads send
+// large datagrams concurrently, and the receiver reports how many of them
+// were reassembled correctly.
+//
+// Options:
+//  -f <func>  : function ('send' or 'recv')
+//  -t <n>     : number of sender threads
+//  -s <size>  : payload size (bytes)
+//  -r <rate>  : datagrams per second of each sender thread (0: as fast as possible)
+//
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <udpdk_api.h>
+
+#define PORT_SEND   10000
+#define PORT_RECV   10001
+#define IP_RECV     "172.31.100.1"
+
+#define MAX_THREADS 16
+#define MAX_PAYLOAD 65507
+
+/* Header of each datagram, followed by a pattern that depends on it */
+typedef struct dgram_hdr_t {
+    uint32_t thread;
+    uint32_t pad;
+    uint64_t seq;
+} dgram_hdr_t;
+
+/* Counters of a sender thread, or of the receiver for a sender thread */
+typedef struct flow_stats_t {
+    volatile uint64_t sent;
+    volatile uint64_t recv;
+    volatile uint64_t corrupted;
+    volatile uint64_t max_seq;      // highest sequence number received + 1
+} flow_stats_t;
+
+typedef enum {SEND, RECV} app_mode;
+
+static app_mode mode = SEND;
+static int n_threads = 1;
+static int pktlen = 8000;
+static uint64_t tx_rate = 0;
+static volatile bool app_alive = true;
+static flow_stats_t flows[MAX_THREADS];
+static const char *progname;
+
+static void signal_handler(int signum)
+{
+    printf("Caught signal %d in fragbench main process\n", signum);
+    udpdk_interrupt(signum);
+    app_alive = false;
+}
+
+/* Fill the payload after the header with a pattern, so that mixed fragments are detected */
+static void fill_payload(char *buf, int len, const dgram_hdr_t *hdr)
+{
+    int i;
+
+    memcpy(buf, hdr, sizeof(*hdr));
+    for (i = sizeof(*hdr); i < len; i++) {
+        buf[i] = (char)(hdr->seq + hdr->thread + i);
+    }
+}
+
+static bool check_payload(const char *buf, int len, const dgram_hdr_t *hdr)
+{
+    int i;
+
+    for (i = sizeof(*hdr); i < len; i++) {
+        if (buf[i] != (char)(hdr->seq + hdr->thread + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *send_body(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    struct sockaddr_in servaddr, destaddr;
+    struct timespec t_next, period;
+    dgram_hdr_t hdr = {.thread = id, .seq = 0};
+    char *buf;
+    int sock;
+
+    buf = malloc(pktlen);
+    if (buf == NULL) {
+        fprintf(stderr, "Send %d: out of memory\n", id);
+        return NULL;
+    }
+
+    // Create a socket
+    if ((sock = udpdk_socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        fprintf(stderr, "Send %d: socket creation failed\n", id);
+        return NULL;
+    }
+    // Bind it (one port per thread)
+    memset(&servaddr, 0, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = INADDR_ANY;
+    servaddr.sin_port = htons(PORT_SEND + id);
+    if (udpdk_bind(sock, (const struct sockaddr *)&servaddr, sizeof(servaddr)) < 0) {
+        fprintf(stderr, "Send %d: bind failed\n", id);
+        return NULL;
+    }
+
+    memset(&destaddr, 0, sizeof(destaddr));
+    destaddr.sin_family = AF_INET;
+    destaddr.sin_addr.s_addr = inet_addr(IP_RECV);
+    destaddr.sin_port = htons(PORT_RECV);
+
+    if (tx_rate > 0) {
+        period.tv_sec = 0;
+        period.tv_nsec = 1000000000 / tx_rate;
+        clock_gettime(CLOCK_MONOTONIC, &t_next);
+    }
+
+    while (app_alive) {
+        // Pace the sends, if requested
+        if (tx_rate > 0) {
+            t_next.tv_nsec += period.tv_nsec;
+            if (t_next.tv_nsec >= 1000000000) {
+                t_next.tv_sec++;
+                t_next.tv_nsec -= 1000000000;
+            }
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t_next, NULL) != 0);
+        }
+        fill_payload(buf, pktlen, &hdr);
+        if (udpdk_sendto(sock, buf, pktlen, 0, (const struct sockaddr *)&destaddr, sizeof(destaddr)) > 0) {
+            flows[id].sent++;
+            hdr.seq++;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+static void recv_body(void)
+{
+    struct sockaddr_in servaddr, cliaddr;
+    socklen_t len;
+    dgram_hdr_t hdr;
+    char *buf;
+    int sock, n;
+
+    buf = malloc(MAX_PAYLOAD);
+    if (buf == NULL) {
+        fprintf(stderr, "Recv: out of memory\n");
+        return;
+    }
+
+    // Create a socket
+    if ((sock = udpdk_socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        fprintf(stderr, "Recv: socket creation failed\n");
+        return;
+    }
+    // Bind it
+    memset(&servaddr, 0, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = INADDR_ANY;
+    servaddr.sin_port = htons(PORT_RECV);
+    if (udpdk_bind(sock, (const struct sockaddr *)&servaddr, sizeof(servaddr)) < 0) {
+        fprintf(stderr, "Recv: bind failed\n");
+        return;
+    }
+
+    while (app_alive) {
+        len = sizeof(cliaddr);
+        n = udpdk_recvfrom(sock, buf, MAX_PAYLOAD, 0, (struct sockaddr *)&cliaddr, &len);
+        if (n < (int)sizeof(hdr)) {
+            continue;
+        }
+        memcpy(&hdr, buf, sizeof(hdr));
+        if (hdr.thread >= MAX_THREADS) {
+            continue;
+        }
+        flows[hdr.thread].recv++;
+        if (!check_payload(buf, n, &hdr)) {
+            flows[hdr.thread].corrupted++;
+        } else if (hdr.seq + 1 > flows[hdr.thread].max_seq) {
+            flows[hdr.thread].max_seq = hdr.seq + 1;
+        }
+    }
+    free(buf);
+}
+
+static void *stats_routine(void *arg)
+{
+    struct udpdk_stats st;
+    uint64_t sent, recv, corrupted, expected;
+    int i;
+
+    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+
+    while (1) {
+        sleep(1);
+        sent = recv = corrupted = expected = 0;
+        for (i = 0; i < MAX_THREADS; i++) {
+            sent += flows[i].sent;
+            recv += flows[i].recv;
+            corrupted += flows[i].corrupted;
+            expected += flows[i].max_seq;
+        }
+        if (mode == SEND) {
+            printf("Sent: %lu datagrams of %d bytes from %d threads\n", sent, pktlen, n_threads);
+            continue;
+        }
+        if (udpdk_get_stats(&st) < 0) {
+            continue;
+        }
+        // The datagrams sent are inferred from the sequence numbers received
+        printf("Recv: %lu/%lu datagrams (%.2f%%)  corrupted: %lu  bad IP/UDP cksum: %lu/%lu  "
+                "no mbuf: %lu  NIC missed: %lu\n",
+                recv - corrupted, expected, expected ? 100.0 * (recv - corrupted) / expected : 0.0, corrupted,
+                st.poller.rx_drops[UDPDK_DROP_BAD_IP_CKSUM], st.poller.rx_drops[UDPDK_DROP_BAD_UDP_CKSUM],
+                st.port.rx_nombuf, st.port.imissed);
+    }
+    return NULL;
+}
+
+static void usage(void)
+{
+    printf("%s -c CONFIG -f FUNCTION [-t THREADS] [-s SIZE] [-r RATE]\n"
+            " -c CONFIG: .ini configuration file\n"
+            " -f FUNCTION: 'send' or 'recv'\n"
+            " -t THREADS: number of sender threads (max %d)\n"
+            " -s SIZE: payload size (bytes)\n"
+            " -r RATE: datagrams per second of each sender thread\n"
+            , progname, MAX_THREADS);
+}
+
+static int parse_app_args(int argc, char *argv[])
+{
+    int c;
+
+    progname = argv[0];
+
+    while ((c = getopt(argc, argv, "c:f:t:s:r:")) != -1) {
+        switch (c) {
+            case 'c':
+                // this is for the .ini cfg file needed by DPDK, not by the app
+                break;
+            case 'f':
+                if (strcmp(optarg, "send") == 0) {
+                    mode = SEND;
+                } else if (strcmp(optarg, "recv") == 0) {
+                    mode = RECV;
+                } else {
+                    fprintf(stderr, "Unsupported function %s (must be 'send' or 'recv')\n", optarg);
+                    return -1;
+                }
+                break;
+            case 't':
+                n_threads = atoi(optarg);
+                if (n_threads < 1 || n_threads > MAX_THREADS) {
+                    fprintf(stderr, "Invalid number of threads %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 's':
+                pktlen = atoi(optarg);
+                if (pktlen < (int)sizeof(dgram_hdr_t) || pktlen > MAX_PAYLOAD) {
+                    fprintf(stderr, "Invalid payload size %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'r':
+                tx_rate = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+                usage();
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t stats_thr;
+    pthread_t senders[MAX_THREADS];
+    int retval;
+    int i;
+
+    // Register signals for shutdown
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    // Initialize UDPDK
+    retval = udpdk_init(argc, argv);
+    if (retval < 0) {
+        goto fragbench_end;
+    }
+    printf("App: UDPDK Intialized\n");
+
+    // Parse app-specific arguments
+    retval = parse_app_args(argc, argv);
+    if (retval != 0) {
+        goto fragbench_end;
+    }
+
+    // Start the thread to visualize statistics in real time
+    if (pthread_create(&stats_thr, NULL, stats_routine, NULL)) {
+        fprintf(stderr, "Error creating thread\n");
+        goto fragbench_end;
+    }
+
+    if (mode == SEND) {
+        for (i = 0; i < n_threads; i++) {
+            if (pthread_create(&senders[i], NULL, send_body, (void *)(intptr_t)i)) {
+                fprintf(stderr, "Error creating sender thread %d\n", i);
+                app_alive = false;
+                n_threads = i;
+                break;
+            }
+        }
+        for (i = 0; i < n_threads; i++) {
+            pthread_join(senders[i], NULL);
+        }
+    } else {
+        recv_body();
+    }
+
+    // Halt the stats thread
+    pthread_cancel(stats_thr);
+    pthread_join(stats_thr, NULL);
+
+fragbench_end:
+    // Cleanup
+    udpdk_interrupt(0);
+    udpdk_cleanup();
+    return 0;
+}
@@ -4,6 +4,7 @@
 //
 // Options:
 //  -f <func>  : function ('ping' or 'pong')
+//  -t         : measure with the RX timestamps of UDPDK (requires rx_timestamp in the config)
 //
 
 #include <signal.h>
@@ -16,6 +17,8 @@
 #include <time.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
 
 #include <udpdk_api.h>
 
@@ -34,6 +37,7 @@ static FILE *log;
 static unsigned delay = 1000000;
 static unsigned samples[MAX_SAMPLES];
 static unsigned n_samples = 0;
+static int use_rx_tstamp = 0;
 static const char *progname;
 
 static void signal_handler(int signum)
@@ -47,6 +51,11 @@ static void ping_body(void)
 {
     struct sockaddr_in servaddr, destaddr;
     struct timespec ts, ts_msg, ts_now;
+    struct iovec iov = {.iov_base = &ts_msg, .iov_len = sizeof(ts_msg)};
+    char ctrl[CMSG_SPACE(sizeof(struct scm_timestamping))];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct scm_timestamping *tss;
     int n;
 
     printf("PING mode\n");
@@ -74,6 +83,15 @@ static void ping_body(void)
         fprintf(stderr, "bind failed");
         return;
     }
+    // Request the RX timestamps (hardware, if enabled and supported by the NIC, and software)
+    if (use_rx_tstamp) {
+        int tstamp_flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE
+                | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        if (udpdk_setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &tstamp_flags, sizeof(tstamp_flags)) < 0) {
+            fprintf(stderr, "Ping: cannot enable RX timestamps");
+            return;
+        }
+    }
 
     while (app_alive) {
 
@@ -88,9 +106,26 @@ static void ping_body(void)
                 (const struct sockaddr *) &destaddr, sizeof(destaddr));
 
         // Get pong response
-        n = udpdk_recvfrom(sock, (void *)&ts_msg, sizeof(struct timespec), 0, NULL, NULL);
-        if (n > 0) {
+        if (use_rx_tstamp) {
+            // Take the time at which the pong was received (rather than returned by UDPDK)
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = ctrl;
+            msg.msg_controllen = sizeof(ctrl);
+            n = udpdk_recvmsg(sock, &msg, 0);
             clock_gettime(CLOCK_REALTIME, &ts_now);
+            for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                    tss = (struct scm_timestamping *)CMSG_DATA(cmsg);
+                    ts_now = (tss->ts[2].tv_sec != 0) ? tss->ts[2] : tss->ts[0];
+                }
+            }
+        } else {
+            n = udpdk_recvfrom(sock, (void *)&ts_msg, sizeof(struct timespec), 0, NULL, NULL);
+            clock_gettime(CLOCK_REALTIME, &ts_now);
+        }
+        if (n > 0) {
             ts.tv_sec = ts_now.tv_sec - ts_msg.tv_sec;
             ts.tv_nsec = ts_now.tv_nsec - ts_msg.tv_nsec;
             if (ts.tv_nsec < 0) {
@@ -148,6 +183,7 @@ static void usage(void)
             " -c CONFIG: .ini configuration file\n"
             " -f FUNCTION: 'ping' or 'pong'\n"
             " -d DELAY: delay (microseconds) between two ping invocations\n"
+            " -t: measure with the RX timestamps of UDPDK (ping only)\n"
             , progname);
 }
 
@@ -158,7 +194,7 @@ static int parse_app_args(int argc, char *argv[])
 
     progname = argv[0];
 
-    while ((c = getopt(argc, argv, "c:f:d:l:")) != -1) {
+    while ((c = getopt(argc, argv, "c:f:d:l:t")) != -1) {
         switch (c) {
             case 'c':
                 // this is for the .ini cfg file needed by DPDK, not by the app
@@ -176,6 +212,9 @@ static int parse_app_args(int argc, char *argv[])
             case 'd':
                 delay = atoi(optarg);
                 break;
+            case 't':
+                use_rx_tstamp = 1;
+                break;
             case 'l':
                 log_enabled = 1;
                 log_file = strdup(optarg);
@@ -4,6 +4,8 @@
 //
 // Options:
 //  -f <func>  : function ('send' or 'recv')
+//  -t         : schedule each send at its time with SO_TXTIME (requires txtime in the config)
+//  -j         : measure the jitter of the interarrival times (requires rx_timestamp in the config)
 //
 
 #include <arpa/inet.h>
@@ -17,6 +19,7 @@
 #include <sys/socket.h>
 #include <time.h>
 #include <unistd.h>
+#include <linux/net_tstamp.h>
 
 #include <udpdk_api.h>
 
@@ -30,6 +33,8 @@
 #define IP_HDR_LEN  20
 #define UDP_HDR_LEN 8
 
+#define TXTIME_LEAD_NS  100000  // how early a scheduled packet is handed to UDPDK (-t)
+
 typedef struct stats_t {
     uint64_t pkts_sent;
     uint64_t pkts_recv;
@@ -39,6 +44,9 @@ typedef struct stats_t {
     uint64_t bytes_recv;
     uint64_t bytes_sent_prev;
     uint64_t bytes_recv_prev;
+    uint64_t jitter_count;      // interarrival times measured in the last second (-j)
+    uint64_t jitter_sum_ns;     // sum of their deviations from the expected ones
+    uint64_t jitter_max_ns;     // largest deviation
 } stats_t;
 
 const char mydata[2048] = {
@@ -53,6 +61,9 @@ static app_mode mode = SEND;
 static int pktlen = 64;
 static bool hdr_stats = false;
 static bool dump = false;
+static bool poller_pacing = false;
+static bool txtime = false;
+static bool jitter = false;
 static uint64_t tx_rate = 0;
 static struct timespec tx_period;
 static volatile bool app_alive = true;
@@ -104,10 +115,44 @@ static struct timespec wait_time(struct timespec ts)
 #endif
 }
 
+static inline uint64_t timespec_to_ns(struct timespec ts)
+{
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Send a packet that UDPDK must not transmit before t_launch (SCM_TXTIME) */
+static int send_at(int sock, const void *buf, size_t len, const struct sockaddr_in *destaddr,
+        struct timespec t_launch)
+{
+    char ctrl[CMSG_SPACE(sizeof(uint64_t))];
+    struct iovec iov = {.iov_base = (void *)buf, .iov_len = len};
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    uint64_t txtime_ns = timespec_to_ns(t_launch);
+
+    memset(&msg, 0, sizeof(msg));
+    memset(ctrl, 0, sizeof(ctrl));
+    msg.msg_name = (void *)destaddr;
+    msg.msg_namelen = sizeof(*destaddr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_TXTIME;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(txtime_ns));
+    memcpy(CMSG_DATA(cmsg), &txtime_ns, sizeof(txtime_ns));
+    return udpdk_sendmsg(sock, &msg, 0);
+}
+
 static void send_body(stats_t *stats)
 {
     struct sockaddr_in servaddr, destaddr;
     struct timespec t_next;
+    struct timespec txtime_lead = {0, TXTIME_LEAD_NS};
+    static char buf[2048];
+    uint64_t seq = 0;
     int n;
 
     printf("SEND mode\n");
@@ -128,6 +173,34 @@ static void send_body(stats_t *stats)
         return;
     }
 
+    // Let the poller pace the packets, instead of waiting before each send
+    if (poller_pacing && tx_rate > 0) {
+        struct udpdk_tx_rate rate = {.pkts_per_sec = tx_rate, .burst_pkts = 1};
+        if (udpdk_setsockopt(sock, SOL_UDPDK, UDPDK_SO_TX_RATE, &rate, sizeof(rate)) < 0) {
+            fprintf(stderr, "Send: cannot set the rate limit");
+            return;
+        }
+        printf("Sending %lu packets per second, paced by the poller\n", tx_rate);
+        tx_rate = 0;
+    }
+
+    // Let the poller send each packet at its time, handing it over a bit earlier
+    if (txtime) {
+        struct sock_txtime txtime_opt = {.clockid = CLOCK_REALTIME, .flags = 0};
+        if (tx_rate == 0) {
+            fprintf(stderr, "Send: scheduled transmissions need a rate (-r)");
+            return;
+        }
+        if (udpdk_setsockopt(sock, SOL_SOCKET, SO_TXTIME, &txtime_opt, sizeof(txtime_opt)) < 0) {
+            fprintf(stderr, "Send: cannot enable SO_TXTIME");
+            return;
+        }
+        printf("Scheduling the packets with SO_TXTIME\n");
+    }
+
+    // The payload starts with a sequence number, for the receiver to measure the jitter
+    memcpy(buf, mydata, sizeof(buf));
+
     tx_period.tv_sec = tx_period.tv_nsec = 0;
     if (tx_rate > 0) {
         uint64_t x = (uint64_t)1000000000 / (uint64_t)tx_rate;
@@ -144,17 +217,25 @@ static void send_body(stats_t *stats)
     while (app_alive) {
         int ret;
 
-        // Wait for the right moment to send the packet
+        // Wait for the right moment to send the packet (or to schedule it)
         if (tx_rate > 0) {
             t_next = timespec_add(t_next, tx_period);
-            wait_time(t_next);
+            wait_time(txtime ? timespec_sub(t_next, txtime_lead) : t_next);
         }
         // Send packet
         destaddr.sin_family = AF_INET;
         destaddr.sin_addr.s_addr = inet_addr(IP_RECV);
         destaddr.sin_port = htons(PORT_RECV);
-        ret = udpdk_sendto(sock, (void *)mydata, pktlen, 0,
-                (const struct sockaddr *) &destaddr, sizeof(destaddr));
+        if (jitter) {
+            memcpy(buf, &seq, sizeof(seq));
+            seq++;
+        }
+        if (txtime) {
+            ret = send_at(sock, buf, pktlen, &destaddr, t_next);
+        } else {
+            ret = udpdk_sendto(sock, (void *)buf, pktlen, 0,
+                    (const struct sockaddr *) &destaddr, sizeof(destaddr));
+        }
         if (ret > 0) {
             stats->pkts_sent++;
             stats->bytes_sent += ret;
@@ -165,12 +246,67 @@ static void send_body(stats_t *stats)
     }
 }
 
+/* Receive a packet with the time at which the poller took it from the NIC (SCM_TIMESTAMPNS) */
+static int recv_stamped(int sock, char *buf, size_t len, struct sockaddr_in *cliaddr, struct timespec *ts)
+{
+    char ctrl[CMSG_SPACE(sizeof(struct timespec))];
+    struct iovec iov = {.iov_base = buf, .iov_len = len};
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int n;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = cliaddr;
+    msg.msg_namelen = sizeof(*cliaddr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    n = udpdk_recvmsg(sock, &msg, 0);
+    if (n <= 0) {
+        return n;
+    }
+    clock_gettime(CLOCK_REALTIME, ts);
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(ts, CMSG_DATA(cmsg), sizeof(*ts));
+        }
+    }
+    return n;
+}
+
+/* Account the deviation of an interarrival time from the one expected at the sender rate */
+static void jitter_sample(stats_t *stats, uint64_t seq, struct timespec ts)
+{
+    static uint64_t prev_seq;
+    static uint64_t prev_ns;
+    uint64_t period_ns = timespec_to_ns(tx_period);
+    uint64_t now_ns = timespec_to_ns(ts);
+    int64_t dev;
+
+    if (prev_ns != 0 && seq > prev_seq) {
+        dev = (int64_t)(now_ns - prev_ns) - (int64_t)((seq - prev_seq) * period_ns);
+        if (dev < 0) {
+            dev = -dev;
+        }
+        stats->jitter_count++;
+        stats->jitter_sum_ns += dev;
+        if ((uint64_t)dev > stats->jitter_max_ns) {
+            stats->jitter_max_ns = dev;
+        }
+    }
+    prev_seq = seq;
+    prev_ns = now_ns;
+}
+
 static void recv_body(stats_t *stats)
 {
     int sock, n;
     struct sockaddr_in servaddr, cliaddr;
     char buf[2048];
     char clientname[100];
+    struct timespec ts;
+    uint64_t seq;
 
     printf("RECV mode\n");
 
@@ -190,11 +326,34 @@ static void recv_body(stats_t *stats)
         return;
     }
 
+    // Take the arrival times from the poller, and compare them with the period of the sender
+    if (jitter) {
+        int on = 1;
+        if (tx_rate == 0) {
+            fprintf(stderr, "Recv: the jitter needs the rate of the sender (-r)");
+            return;
+        }
+        if (udpdk_setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+            fprintf(stderr, "Recv: cannot enable RX timestamps");
+            return;
+        }
+        tx_period.tv_sec = 0;
+        tx_period.tv_nsec = 1000000000 / tx_rate;
+    }
+
     printf(("Entering recv loop\n"));
     while (app_alive) {
         // Bounce incoming packets
         int len = sizeof(cliaddr);
-        n = udpdk_recvfrom(sock, (void *)buf, 2048, 0, ( struct sockaddr *) &cliaddr, &len);
+        if (jitter) {
+            n = recv_stamped(sock, buf, sizeof(buf) - 1, &cliaddr, &ts);
+            if (n >= (int)sizeof(seq)) {
+                memcpy(&seq, buf, sizeof(seq));
+                jitter_sample(stats, seq, ts);
+            }
+        } else {
+            n = udpdk_recvfrom(sock, (void *)buf, 2048, 0, ( struct sockaddr *) &cliaddr, &len);
+        }
         if (n > 0) {
             stats->pkts_recv++;
             stats->bytes_recv += n;
@@ -213,10 +372,13 @@ static void recv_body(stats_t *stats)
 
 static void usage(void)
 {
-    printf("%s -c CONFIG -f FUNCTION [-r RATE] [-l LEN] [-h] [-d] \n"
+    printf("%s -c CONFIG -f FUNCTION [-r RATE] [-p] [-t] [-j] [-l LEN] [-h] [-d] \n"
             " -c CONFIG: .ini configuration file"
             " -f FUNCTION: 'send' or 'recv'\n"
-            " -r RATE: desired transmission rate (pps)"
+            " -r RATE: desired transmission rate (pps), also of the sender when measuring the jitter"
+            " -p pace the packets in the poller (UDPDK_SO_TX_RATE) rather than in the app\n"
+            " -t schedule each packet at its time with SO_TXTIME, rather than sending it then\n"
+            " -j send sequence numbers (sender) or measure the jitter of the interarrival times (receiver)\n"
             " -s SIZE: payload size (length)\n"
             " -l LOGFILE: path to the logfile\n"
             " -h consider also the MAC, IPv4 and UDP headers bytes for tx_rate and stats\n"
@@ -231,7 +393,7 @@ static int parse_app_args(int argc, char *argv[])
 
     progname = argv[0];
 
-    while ((c = getopt(argc, argv, "c:f:r:s:l:hd")) != -1) {
+    while ((c = getopt(argc, argv, "c:f:r:s:l:hdptj")) != -1) {
         switch (c) {
             case 'c':
                 // this is for the .ini cfg file needed by DPDK, not by the app
@@ -266,6 +428,15 @@ static int parse_app_args(int argc, char *argv[])
             case 'd':
                 dump = true;
                 break;
+            case 'p':
+                poller_pacing = true;
+                break;
+            case 't':
+                txtime = true;
+                break;
+            case 'j':
+                jitter = true;
+                break;
             default:
                 fprintf(stderr, "Unknown option `-%c'.\n", optopt);
                 usage();
@@ -285,6 +456,9 @@ static void reset_stats(stats_t *stats)
     stats->bytes_recv = 0;
     stats->bytes_sent_prev = 0;
     stats->bytes_recv_prev = 0;
+    stats->jitter_count = 0;
+    stats->jitter_sum_ns = 0;
+    stats->jitter_max_ns = 0;
 }
 
 static void *stats_routine(void *arg)
@@ -313,6 +487,13 @@ static void *stats_routine(void *arg)
         stats->pkts_recv_prev = stats->pkts_recv;
         stats->bytes_sent_prev = stats->bytes_sent;
         stats->bytes_recv_prev = stats->bytes_recv;
+        if (jitter && stats->jitter_count > 0) {
+            printf("Jitter: mean %lu ns  max %lu ns  (%lu interarrivals)\n",
+                    stats->jitter_sum_ns / stats->jitter_count, stats->jitter_max_ns, stats->jitter_count);
+            stats->jitter_count = 0;
+            stats->jitter_sum_ns = 0;
+            stats->jitter_max_ns = 0;
+        }
         sleep(1);
     }
     return NULL;
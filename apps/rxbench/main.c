@@ -0,0 +1,217 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+// Microbenchmark of the parsers of RX headers used by the poller (scalar,
+// SSE4.2, AVX2). A set of synthetic packets, larger than the caches, is
+// parsed in bursts by each parser, and the cycles per packet are reported,
+// without and with the prefetching of mbufs and headers. No NIC nor hugepages
+// are needed.
+//
+// Options:
+//  -b <n>     : burst size
+//  -n <n>     : number of packets in the set
+//  -i <n>     : number of passes over the set
+//  -s <pct>   : percentage of packets off the fast path (fragments, non-UDP)
+//  -p <n>     : prefetch distance (packets) compared with no prefetching
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_byteorder.h>
+#include <rte_cycles.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+#include <rte_udp.h>
+
+#include <udpdk_rx_parse.h>
+
+#define PKT_BUF_SIZE    2048    // as the mbufs of the RX pool
+#define MAX_BURST       RX_MBUF_TABLE_SIZE
+
+static int burst = 32;
+static int n_pkts = 65536;
+static int n_iter = 100;
+static int slow_pct = 0;
+static int pf_dist = 4;
+static const char *progname;
+
+/* Build a packet: an unfragmented IPv4/UDP datagram, or (if slow) a fragment or a TCP segment */
+static void build_pkt(struct rte_mbuf *m, void *buf, int idx, int slow)
+{
+    struct rte_ether_hdr *eth_hdr;
+    struct rte_ipv4_hdr *ip_hdr;
+    struct rte_udp_hdr *udp_hdr;
+
+    memset(m, 0, sizeof(*m));
+    m->buf_addr = buf;
+    m->data_off = RTE_PKTMBUF_HEADROOM;
+    m->data_len = m->pkt_len = 64;
+
+    eth_hdr = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    eth_hdr->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+    ip_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+    ip_hdr->version_ihl = 0x45;
+    ip_hdr->time_to_live = 64;
+    ip_hdr->next_proto_id = IPPROTO_UDP;
+    ip_hdr->dst_addr = rte_cpu_to_be_32(0xac1f6401);
+    udp_hdr = (struct rte_udp_hdr *)(ip_hdr + 1);
+    udp_hdr->dst_port = rte_cpu_to_be_16(10000 + idx % 4);
+    if (slow) {
+        if (idx & 1) {
+            ip_hdr->fragment_offset = rte_cpu_to_be_16(RTE_IPV4_HDR_MF_FLAG);
+        } else {
+            ip_hdr->next_proto_id = IPPROTO_TCP;
+        }
+    }
+}
+
+static void usage(void)
+{
+    printf("%s [-b BURST] [-n PKTS] [-i ITER] [-s SLOW] [-p DIST]\n"
+            " -b BURST: burst size (max %d)\n"
+            " -n PKTS: number of packets in the set\n"
+            " -i ITER: number of passes over the set\n"
+            " -s SLOW: percentage of packets off the fast path\n"
+            " -p DIST: prefetch distance (packets)\n"
+            , progname, MAX_BURST);
+}
+
+static int parse_app_args(int argc, char *argv[])
+{
+    int c;
+
+    progname = argv[0];
+
+    while ((c = getopt(argc, argv, "b:n:i:s:p:")) != -1) {
+        switch (c) {
+            case 'b':
+                burst = atoi(optarg);
+                if (burst < 1 || burst > MAX_BURST) {
+                    fprintf(stderr, "Invalid burst size %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'n':
+                n_pkts = atoi(optarg);
+                if (n_pkts < MAX_BURST) {
+                    fprintf(stderr, "Invalid number of packets %s (min %d)\n", optarg, MAX_BURST);
+                    return -1;
+                }
+                break;
+            case 'i':
+                n_iter = atoi(optarg);
+                if (n_iter < 1) {
+                    fprintf(stderr, "Invalid number of passes %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 's':
+                slow_pct = atoi(optarg);
+                if (slow_pct < 0 || slow_pct > 100) {
+                    fprintf(stderr, "Invalid percentage %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'p':
+                pf_dist = atoi(optarg);
+                if (pf_dist < 1 || pf_dist > MAX_BURST / 2) {
+                    fprintf(stderr, "Invalid prefetch distance %s\n", optarg);
+                    return -1;
+                }
+                break;
+            default:
+                fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+                usage();
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    enum udpdk_rx_parser parsers[] = {UDPDK_RX_PARSER_SCALAR, UDPDK_RX_PARSER_SSE42, UDPDK_RX_PARSER_AVX2};
+    uint8_t fast[MAX_BURST], ref_fast[MAX_BURST];
+    uint32_t dst_addr[MAX_BURST], ref_addr[MAX_BURST];
+    uint16_t dst_port[MAX_BURST], ref_port[MAX_BURST];
+    struct rte_mbuf *mbufs;
+    struct rte_mbuf **pkts;
+    struct rte_mbuf *m;
+    udpdk_rx_parse_t parse, ref_parse;
+    uint64_t start, cycles[2];
+    char *bufs;
+    unsigned p;
+    int i, j, k, n, pf;
+
+    if (parse_app_args(argc, argv) != 0) {
+        return 1;
+    }
+
+    // Lay out the packets as in a pool (one buffer each), in random order
+    mbufs = aligned_alloc(RTE_CACHE_LINE_SIZE, n_pkts * sizeof(struct rte_mbuf));
+    bufs = aligned_alloc(RTE_CACHE_LINE_SIZE, (size_t)n_pkts * PKT_BUF_SIZE);
+    pkts = malloc(n_pkts * sizeof(struct rte_mbuf *));
+    if (mbufs == NULL || bufs == NULL || pkts == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < n_pkts; i++) {
+        build_pkt(&mbufs[i], bufs + (size_t)i * PKT_BUF_SIZE, i, rand() % 100 < slow_pct);
+        pkts[i] = &mbufs[i];
+    }
+    for (i = n_pkts - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        m = pkts[i];
+        pkts[i] = pkts[j];
+        pkts[j] = m;
+    }
+
+    printf("%d packets (%d%% off the fast path), bursts of %d, %d passes\n", n_pkts, slow_pct, burst, n_iter);
+    ref_parse = udpdk_rx_parse_select(&parsers[0]);
+    for (p = 0; p < RTE_DIM(parsers); p++) {
+        parse = udpdk_rx_parse_select(&parsers[p]);
+        if (parse == NULL) {
+            printf("%-8s: not supported by the CPU\n", udpdk_rx_parser_name(parsers[p]));
+            continue;
+        }
+        // Check that the parser agrees with the scalar one
+        for (i = 0; i < n_pkts; i += n) {
+            n = RTE_MIN(burst, n_pkts - i);
+            ref_parse(&pkts[i], n, ref_fast, ref_addr, ref_port, 0);
+            parse(&pkts[i], n, fast, dst_addr, dst_port, pf_dist);
+            for (k = 0; k < n; k++) {
+                if (fast[k] != ref_fast[k]
+                        || (fast[k] && (dst_addr[k] != ref_addr[k] || dst_port[k] != ref_port[k]))) {
+                    fprintf(stderr, "%s: wrong result for packet %d\n", udpdk_rx_parser_name(parsers[p]), i + k);
+                    return 1;
+                }
+            }
+        }
+        // Measure, without and with prefetching, alternating them and keeping the best pass of each
+        cycles[0] = cycles[1] = UINT64_MAX;
+        for (j = 0; j < 2 * n_iter; j++) {
+            k = j & 1;
+            pf = k ? pf_dist : 0;
+            start = rte_rdtsc();
+            for (i = 0; i < n_pkts; i += n) {
+                n = RTE_MIN(burst, n_pkts - i);
+                parse(&pkts[i], n, fast, dst_addr, dst_port, pf);
+            }
+            cycles[k] = RTE_MIN(cycles[k], rte_rdtsc() - start);
+        }
+        printf("%-8s: %6.2f cycles/packet, %6.2f with prefetch distance %d (%+.1f%%)\n",
+                udpdk_rx_parser_name(parsers[p]),
+                (double)cycles[0] / n_pkts, (double)cycles[1] / n_pkts,
+                pf_dist, 100.0 * ((double)cycles[1] - cycles[0]) / cycles[0]);
+    }
+
+    free(pkts);
+    free(bufs);
+    free(mbufs);
+    return 0;
+}
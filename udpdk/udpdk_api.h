@@ -35,11 +35,21 @@ int udpdk_bind(int s, const struct sockaddr *addr, socklen_t addrlen);
 ssize_t udpdk_sendto(int sockfd, const void *buf, size_t len, int flags,
         const struct sockaddr *dest_addr, socklen_t addrlen);
 
+ssize_t udpdk_sendmsg(int sockfd, const struct msghdr *msg, int flags);
+
 ssize_t udpdk_recvfrom(int s, void *buf, size_t len, int flags,
         struct sockaddr *src_addr, socklen_t *addrlen);
 
+ssize_t udpdk_recvmsg(int sockfd, struct msghdr *msg, int flags);
+
 int udpdk_close(int s);
 
+int udpdk_get_sock_stats(int sockfd, struct udpdk_sock_stats *stats);
+
+int udpdk_get_stats(struct udpdk_stats *stats);
+
+int udpdk_get_sock_latency(int sockfd, struct udpdk_sock_latency *lat);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,6 +4,7 @@
 //
 #include <arpa/inet.h>  // for inet_addr
 
+#include <rte_common.h>
 #include <rte_ether.h>
 
 #include "ini.h"
@@ -30,6 +31,12 @@ static int parse_handler(void* configuration, const char* section, const char* n
         if (config.src_ip_addr.s_addr == (in_addr_t)(-1)) {
             fprintf(stderr, "Can't parse IPv4 address: %s\n", value);
         }
+    } else if (MATCH("port0", "mtu")) {
+        config.mtu = atoi(value);
+        if (config.mtu < IPV4_MTU_MIN || config.mtu > IPV4_MTU_MAX) {
+            fprintf(stderr, "Invalid MTU: %s (must be between %d and %d)\n", value, IPV4_MTU_MIN, IPV4_MTU_MAX);
+            return 0;
+        }
     }else if (MATCH("port0_dst", "mac_addr")) {
         if (rte_ether_unformat_addr(value, &config.dst_mac_addr) < 0) {
             fprintf(stderr, "Can't parse MAC address: %s\n", value);
@@ -41,6 +48,126 @@ static int parse_handler(void* configuration, const char* section, const char* n
         strncpy(config.lcores_secondary, value, MAX_ARG_LEN);
     } else if (MATCH("dpdk", "n_mem_channels")) {
         config.n_mem_channels = atoi(value);
+    } else if (MATCH("udpdk", "latency_trace")) {
+        config.latency_trace = atoi(value);
+    } else if (MATCH("udpdk", "app_frag")) {
+        config.app_frag = atoi(value);
+        if (config.app_frag < 0) {
+            fprintf(stderr, "Invalid app_frag: %s\n", value);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "frag_buckets")) {
+        config.frag_buckets = atoi(value);
+        if (config.frag_buckets < NUM_FLOWS_MIN) {
+            fprintf(stderr, "Invalid frag_buckets: %s\n", value);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "frag_bucket_entries")) {
+        config.frag_bucket_entries = atoi(value);
+        if (config.frag_bucket_entries <= 0 || !rte_is_power_of_2(config.frag_bucket_entries)) {
+            fprintf(stderr, "Invalid frag_bucket_entries: %s (must be a power of 2)\n", value);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "frag_max_entries")) {
+        config.frag_max_entries = atoi(value);
+        if (config.frag_max_entries < NUM_FLOWS_MIN || config.frag_max_entries > NUM_FLOWS_MAX) {
+            fprintf(stderr, "Invalid frag_max_entries: %s (must be between %d and %d)\n",
+                    value, NUM_FLOWS_MIN, NUM_FLOWS_MAX);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "frag_ttl_ms")) {
+        config.frag_ttl_ms = atoi(value);
+        if (config.frag_ttl_ms <= 0) {
+            fprintf(stderr, "Invalid frag_ttl_ms: %s\n", value);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "frag_max_per_src")) {
+        config.frag_max_per_src = atoi(value);
+        if (config.frag_max_per_src < 0) {
+            fprintf(stderr, "Invalid frag_max_per_src: %s\n", value);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "fragmentation")) {
+        config.tx_frag = atoi(value);
+    } else if (MATCH("udpdk", "reassembly")) {
+        config.rx_reasm = atoi(value);
+    } else if (MATCH("udpdk", "shared_ports")) {
+        config.shared_ports = atoi(value);
+    } else if (MATCH("udpdk", "prio_high")) {
+        config.prio_high = atoi(value);
+        if (config.prio_high < 1 || config.prio_high > SO_PRIORITY_MAX) {
+            fprintf(stderr, "Invalid prio_high: %s (must be between 1 and %d)\n", value, SO_PRIORITY_MAX);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "prio_txq")) {
+        config.prio_txq = atoi(value);
+    } else if (MATCH("udpdk", "txtime")) {
+        config.txtime = atoi(value);
+    } else if (MATCH("udpdk", "txtime_tick_ns")) {
+        config.txtime_tick_ns = atoi(value);
+        if (config.txtime_tick_ns <= 0) {
+            fprintf(stderr, "Invalid txtime_tick_ns: %s\n", value);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "rx_prefetch")) {
+        config.rx_prefetch = atoi(value);
+        if (config.rx_prefetch < 0 || config.rx_prefetch > RX_PREFETCH_MAX) {
+            fprintf(stderr, "Invalid rx_prefetch: %s (must be between 0 and %d)\n", value, RX_PREFETCH_MAX);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "tx_flush")) {
+        if (strcmp(value, "immediate") == 0) {
+            config.tx_flush = UDPDK_TX_FLUSH_IMMEDIATE;
+        } else if (strcmp(value, "coalesce") == 0) {
+            config.tx_flush = UDPDK_TX_FLUSH_COALESCE;
+        } else if (strcmp(value, "adaptive") == 0) {
+            config.tx_flush = UDPDK_TX_FLUSH_ADAPTIVE;
+        } else {
+            fprintf(stderr, "Unknown tx_flush: %s (must be 'immediate', 'coalesce' or 'adaptive')\n", value);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "tx_burst")) {
+        config.tx_burst = atoi(value);
+        if (config.tx_burst < 1 || config.tx_burst > BURST_SIZE) {
+            fprintf(stderr, "Invalid tx_burst: %s (must be between 1 and %d)\n", value, BURST_SIZE);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "tx_flush_us")) {
+        config.tx_flush_us = atoi(value);
+        if (config.tx_flush_us <= 0) {
+            fprintf(stderr, "Invalid tx_flush_us: %s\n", value);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "rxq_hold_ms")) {
+        config.rxq_hold_ms = atoi(value);
+        if (config.rxq_hold_ms <= 0) {
+            fprintf(stderr, "Invalid rxq_hold_ms: %s\n", value);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "rx_parser")) {
+        if (strcmp(value, "auto") == 0) {
+            config.rx_parser = UDPDK_RX_PARSER_AUTO;
+        } else if (strcmp(value, "scalar") == 0) {
+            config.rx_parser = UDPDK_RX_PARSER_SCALAR;
+        } else if (strcmp(value, "sse4.2") == 0) {
+            config.rx_parser = UDPDK_RX_PARSER_SSE42;
+        } else if (strcmp(value, "avx2") == 0) {
+            config.rx_parser = UDPDK_RX_PARSER_AVX2;
+        } else {
+            fprintf(stderr, "Unknown rx_parser: %s (must be 'auto', 'scalar', 'sse4.2' or 'avx2')\n", value);
+            return 0;
+        }
+    } else if (MATCH("udpdk", "rx_timestamp")) {
+        if (strcmp(value, "none") == 0) {
+            config.rx_timestamp = UDPDK_TSTAMP_NONE;
+        } else if (strcmp(value, "software") == 0) {
+            config.rx_timestamp = UDPDK_TSTAMP_SOFTWARE;
+        } else if (strcmp(value, "hardware") == 0) {
+            config.rx_timestamp = UDPDK_TSTAMP_HARDWARE;
+        } else {
+            fprintf(stderr, "Unknown rx_timestamp: %s (must be 'none', 'software' or 'hardware')\n", value);
+            return 0;
+        }
     } else {
         fprintf(stderr, "Do not know how to parse section:%s name:%s\n", section, name);
         return 0;   // unknown section/name
@@ -148,6 +275,22 @@ int udpdk_parse_args(int argc, char *argv[])
     argc--;
     argv++;
 
+    // Defaults of the optional settings
+    config.mtu = IPV4_MTU_DEFAULT;
+    config.frag_buckets = NUM_FLOWS_DEF;
+    config.frag_bucket_entries = IP_FRAG_TBL_BUCKET_ENTRIES;
+    config.frag_max_entries = NUM_FLOWS_MAX;
+    config.frag_ttl_ms = MAX_FLOW_TTL;
+    config.rx_prefetch = PREFETCH_OFFSET;
+    config.tx_burst = BURST_SIZE;
+    config.tx_flush_us = TX_FLUSH_US_DEFAULT;
+    config.rxq_hold_ms = RXQ_HOLD_MS_DEFAULT;
+    config.tx_frag = 1;
+    config.rx_reasm = 1;
+    config.shared_ports = 1;
+    config.prio_high = PRIO_HIGH_DEFAULT;
+    config.txtime_tick_ns = TXTIME_TICK_NS_DEFAULT;
+
     if (ini_parse(cfg_filename, parse_handler, NULL) < 0) {
         fprintf(stderr, "Can not parse configuration file %s\n", cfg_filename);
         return -1;
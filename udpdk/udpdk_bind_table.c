@@ -14,6 +14,8 @@
 
 #define RTE_LOGTYPE_BTABLE RTE_LOGTYPE_USER1
 
+extern configuration config;
+
 const void *bind_info_alloc = NULL;
 udpdk_list_t **sock_bind_table;
 
@@ -58,6 +60,10 @@ static inline bool btable_can_bind(struct in_addr ip, int port, int opts)
     if (sock_bind_table[port] == NULL) {
         return true;
     }
+    // The poller delivers to a single socket per port if sharing is disabled
+    if (!config.shared_ports) {
+        return false;
+    }
 
     ip_new = ip.s_addr;
 
@@ -0,0 +1,157 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+// Internet checksum (RFC 1071) in software, vectorized with SSE2/AVX2 when
+// available, for the packets whose checksum was not verified by the NIC
+//
+
+#ifndef UDPDK_CKSUM_H
+#define UDPDK_CKSUM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <rte_byteorder.h>
+#include <rte_common.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+#include <rte_udp.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <rte_vect.h>
+#endif
+
+/* Sum the buffer as 32-bit words in 64-bit lanes (folded later), then the leftover bytes */
+static inline uint64_t udpdk_cksum_partial(const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    uint64_t sum = 0;
+    uint32_t w32;
+    uint16_t w16;
+
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    const __m256i zero = _mm256_setzero_si256();
+    for (; len >= 32; p += 32, len -= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(v, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(v, zero));
+    }
+    __m128i acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum += (uint64_t)_mm_cvtsi128_si64(acc128) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc128, acc128));
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    for (; len >= 16; p += 16, len -= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+    }
+    sum += (uint64_t)_mm_cvtsi128_si64(acc) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+#endif
+    for (; len >= 4; p += 4, len -= 4) {
+        memcpy(&w32, p, sizeof(w32));
+        sum += w32;
+    }
+    if (len >= 2) {
+        memcpy(&w16, p, sizeof(w16));
+        sum += w16;
+        p += 2;
+        len -= 2;
+    }
+    if (len == 1) {
+        w16 = 0;
+        *(uint8_t *)&w16 = *p;
+        sum += w16;
+    }
+    return sum;
+}
+
+/* Fold a partial sum to 16 bits (one's complement) */
+static inline uint16_t udpdk_cksum_fold(uint64_t sum)
+{
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    return (uint16_t)sum;
+}
+
+/* Sum len bytes of a (possibly segmented) mbuf starting at off */
+static inline uint64_t udpdk_cksum_mbuf(const struct rte_mbuf *m, uint32_t off, uint32_t len)
+{
+    uint64_t sum = 0;
+    uint32_t done = 0;
+    uint32_t seg_len;
+    uint16_t part;
+
+    // Skip the segments before the offset
+    while (m != NULL && off >= m->data_len) {
+        off -= m->data_len;
+        m = m->next;
+    }
+    for (; m != NULL && done < len; m = m->next, off = 0) {
+        seg_len = RTE_MIN((uint32_t)(m->data_len - off), len - done);
+        part = udpdk_cksum_fold(udpdk_cksum_partial(rte_pktmbuf_mtod_offset(m, const void *, off), seg_len));
+        // A segment starting at an odd position has its bytes swapped w.r.t. the 16-bit words
+        sum += (done & 1) ? rte_bswap16(part) : part;
+        done += seg_len;
+    }
+    return sum;
+}
+
+/* Check the IPv4 header checksum */
+static inline int udpdk_ipv4_cksum_ok(const struct rte_ipv4_hdr *ip_hdr)
+{
+    uint32_t hdr_len = (ip_hdr->version_ihl & RTE_IPV4_HDR_IHL_MASK) * RTE_IPV4_IHL_MULTIPLIER;
+
+    return udpdk_cksum_fold(udpdk_cksum_partial(ip_hdr, hdr_len)) == 0xffff;
+}
+
+/* Compute the IPv4 header checksum (e.g. after the header was modified by reassembly) */
+static inline uint16_t udpdk_ipv4_cksum(const struct rte_ipv4_hdr *ip_hdr)
+{
+    uint32_t hdr_len = (ip_hdr->version_ihl & RTE_IPV4_HDR_IHL_MASK) * RTE_IPV4_IHL_MULTIPLIER;
+    uint16_t cksum = ~udpdk_cksum_fold(udpdk_cksum_partial(ip_hdr, hdr_len));
+
+    return cksum;
+}
+
+/* Sum the pseudo-header, the UDP header and the payload of a datagram; l4_off is the offset of the UDP header */
+static inline uint64_t udpdk_udp_cksum_sum(const struct rte_mbuf *m, const struct rte_ipv4_hdr *ip_hdr,
+                                           const struct rte_udp_hdr *udp_hdr, uint32_t l4_off)
+{
+    uint64_t sum;
+
+    sum = (uint64_t)ip_hdr->src_addr + ip_hdr->dst_addr
+            + rte_cpu_to_be_16((uint16_t)IPPROTO_UDP) + udp_hdr->dgram_len;
+    return sum + udpdk_cksum_mbuf(m, l4_off, rte_be_to_cpu_16(udp_hdr->dgram_len));
+}
+
+/* Compute the UDP checksum of a datagram (possibly segmented), whose checksum field is zero */
+static inline uint16_t udpdk_udp_cksum(const struct rte_mbuf *m, const struct rte_ipv4_hdr *ip_hdr,
+                                       const struct rte_udp_hdr *udp_hdr, uint32_t l4_off)
+{
+    uint16_t cksum = ~udpdk_cksum_fold(udpdk_udp_cksum_sum(m, ip_hdr, udp_hdr, l4_off));
+
+    // Zero means 'no checksum' in UDP, so it is transmitted as all ones
+    return (cksum == 0) ? 0xffff : cksum;
+}
+
+/* Check the UDP checksum of a datagram (possibly segmented) */
+static inline int udpdk_udp_cksum_ok(const struct rte_mbuf *m, const struct rte_ipv4_hdr *ip_hdr,
+                                     const struct rte_udp_hdr *udp_hdr, uint32_t l4_off)
+{
+    uint16_t dgram_len = rte_be_to_cpu_16(udp_hdr->dgram_len);
+
+    // A zero checksum means that the sender did not compute it
+    if (udp_hdr->dgram_cksum == 0) {
+        return 1;
+    }
+    if (unlikely(dgram_len < sizeof(struct rte_udp_hdr) || l4_off + dgram_len > m->pkt_len)) {
+        return 0;
+    }
+    return udpdk_cksum_fold(udpdk_udp_cksum_sum(m, ip_hdr, udp_hdr, l4_off)) == 0xffff;
+}
+
+#endif  // UDPDK_CKSUM_H
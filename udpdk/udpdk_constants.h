@@ -17,6 +17,8 @@
 #define PORT_TX     0
 #define QUEUE_RX    0
 #define QUEUE_TX    0
+#define QUEUE_TX_PRIO   1   // dedicated to the high-priority sockets (prio_txq)
+#define NUM_QUEUES_MAX  4
 #define NUM_RX_DESC_DEFAULT 2048 
 #define NUM_TX_DESC_DEFAULT 2048 
 #define MBUF_CACHE_SIZE     512
@@ -24,6 +26,8 @@
 #define PKTMBUF_POOL_TX_NAME            "UDPDK_mbuf_pool_TX"
 #define PKTMBUF_POOL_DIRECT_TX_NAME     "UDPDK_mbuf_pool_direct_TX"
 #define PKTMBUF_POOL_INDIRECT_TX_NAME   "UDPDK_mbuf_pool_indir_TX"
+#define PKTMBUF_POOL_FRAG_DIRECT_NAME   "UDPDK_mbuf_pool_frag_direct_%d"
+#define PKTMBUF_POOL_FRAG_INDIRECT_NAME "UDPDK_mbuf_pool_frag_indir_%d"
 
 /* Ethernet */
 #define JUMBO_FRAME_MAX_SIZE    0x2600
@@ -34,26 +38,78 @@
 #define NUM_FLOWS_MAX       UINT16_MAX
 #define MAX_FLOW_TTL        MS_PER_S
 #define IP_FRAG_TBL_BUCKET_ENTRIES  16
+#define FRAG_SRC_SLOTS_LOG2 10      // slots (by source address) of the per-source fragment cap
 #define IPV4_MTU_DEFAULT    RTE_ETHER_MTU
+#define IPV4_MTU_MIN        576     // smallest datagram that every IPv4 host must accept (RFC 791)
+#define IPV4_MTU_MAX        (JUMBO_FRAME_MAX_SIZE - RTE_ETHER_HDR_LEN - RTE_ETHER_CRC_LEN)
 #define MAX_PACKET_FRAG     RTE_LIBRTE_IP_FRAG_MAX_FRAG
+#define IPV4_MAX_FRAGS      ((UINT16_MAX - sizeof(struct rte_ipv4_hdr)) / \
+                             ((IPV4_MTU_MIN - sizeof(struct rte_ipv4_hdr)) & ~7) + 1)  // of a 64KB datagram
+#define APP_FRAG_THREADS_MAX    16      // app threads with their own fragmentation pools (app_frag)
+#define APP_FRAG_POOL_SIZE      4095    // mbufs in each fragmentation pool
+
+/* UDP */
+#define UDP_MAX_PAYLOAD     (UINT16_MAX - sizeof(struct rte_ipv4_hdr) - sizeof(struct rte_udp_hdr))
+#define GSO_MAX_SEGS        64      // max datagrams built from a single send (as UDP_MAX_SEGMENTS in Linux)
+#define GSO_MAX_SEGSZ(mtu)  ((mtu) - sizeof(struct rte_ipv4_hdr) - sizeof(struct rte_udp_hdr))
+#define GRO_MAX_SEGS        64      // max datagrams coalesced into a single delivery (UDP_GRO)
 
 /* Packet poller */
 #define BURST_SIZE          128
 #define RX_MBUF_TABLE_SIZE  BURST_SIZE
 #define TX_MBUF_TABLE_SIZE  (2 * MAX(BURST_SIZE, MAX_PACKET_FRAG))
 #define PREFETCH_OFFSET     4
+#define RX_PREFETCH_MAX     (BURST_SIZE / 2)
+#define TX_FLUSH_US_DEFAULT 10      // max wait of a packet in the TX table when coalescing
+#define RXQ_HOLD_MS_DEFAULT 100     // max time a socket under backpressure can stop RX
+#define TX_WEIGHT_DEFAULT   1       // TX quantum of a socket, in max-size frames per round (UDPDK_SO_TX_WEIGHT)
+#define TX_WEIGHT_MAX       64
+#define PRIO_HIGH_DEFAULT   6       // TC_PRIO_INTERACTIVE, the highest SO_PRIORITY for unprivileged Linux sockets
+#define SO_PRIORITY_MAX     15      // as TC_PRIO_MAX in Linux
+#define TX_RATE_BURST_US    100     // default burst of a rate-limited socket, in microseconds at its rate
+#define POLLER_LOG_RATE     10      // max log messages per second on the packet path
+#define POLLER_LOG_BURST    20
+
+/* Poller statistics */
+#define POLLER_STATS_MEMZONE_NAME   "UDPDK_poller_stats"
+
+/* RX timestamps */
+#define UDPDK_TSTAMP_DYNFIELD_NAME  "udpdk_dynfield_rx_tsc"
+#define UDPDK_CLOCK_RESYNC_MS       1000    // period to re-anchor the TSC and NIC clocks to CLOCK_REALTIME
+#define UDPDK_CLOCK_CALIB_MS        100     // interval to estimate the frequency of the NIC clock
+
+/* Scheduled transmission (SO_TXTIME) */
+#define UDPDK_TXTIME_DYNFLAG_NAME   "udpdk_dynflag_txtime"
+#define TXTIME_TICK_NS_DEFAULT      500     // resolution of the timer wheel
+#define TXTIME_WHEEL_BITS           8       // log2 of the slots of each level of the timer wheel
+#define TXTIME_WHEEL_LEVELS         4
+#define TXTIME_WHEEL_MAX_PKTS       16384   // packets the timer wheel can hold (the others are dropped)
+
+/* Latency tracing */
+#define UDPDK_TRACE_DYNFIELD_NAME   "udpdk_dynfield_trace"
+#define UDPDK_LAT_BUCKETS           32      // log2 buckets of cycles (the last one also holds larger values)
 
 /* Exchange memzone */
 #define EXCH_MEMZONE_NAME   "UDPDK_exchange_desc"
 #define EXCH_SLOTS_NAME     "UDPDK_exchange_slots"
-#define EXCH_RING_SIZE      2048
-#define EXCH_RX_RING_NAME   "UDPDK_exchange_ring_%u_RX"
-#define EXCH_TX_RING_NAME   "UDPDK_exchange_ring_%u_TX"
+#define EXCH_RING_SIZE      2048    // default number of entries of socket rings
+#define EXCH_RING_SIZE_MIN  (2 * EXCH_BUF_SIZE)
+#define EXCH_RING_SIZE_MAX  16384
+#define EXCH_RING_ENTRY_BYTES   RTE_MBUF_DEFAULT_DATAROOM   // bytes accounted per ring entry (SO_RCVBUF/SO_SNDBUF)
+#define EXCH_RX_RING_NAME   "UDPDK_exchange_ring_%u_RX%u"   // socket, variant (2 rings coexist while rebuilding)
+#define EXCH_TX_RING_NAME   "UDPDK_exchange_ring_%u_TX%u"
 #define EXCH_BUF_SIZE       BURST_SIZE
 
 /* L4 port switching */
 #define UDP_BIND_TABLE_NAME "UDPDK_btable"
 
+/* Socket options */
+#define SOL_UDPDK       0x5544  // level of UDPDK-specific options
+#define UDPDK_SO_STATS  1       // counters of the socket (struct udpdk_sock_stats, get only)
+#define UDPDK_SO_RXQ_POLICY 2   // what to do when the RX ring is full (enum udpdk_rxq_policy)
+#define UDPDK_SO_TX_WEIGHT  3   // share of the TX bandwidth of the socket when the poller is busy
+#define UDPDK_SO_TX_RATE    4   // rate limit of the transmissions of the socket (struct udpdk_tx_rate)
+
 /* IPv4 header */
 #define IP_DEFTTL       64
 #define IP_VERSION      0x40
@@ -0,0 +1,189 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+// IPv4 fragmentation of the datagrams larger than the MTU. It is done by the
+// poller, or by the sending thread itself if it owns a pair of fragmentation
+// pools (app_frag in the configuration file), so that the cost scales with
+// the number of sender threads instead of loading the single poller core.
+//
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <rte_atomic.h>
+#include <rte_common.h>
+#include <rte_errno.h>
+#include <rte_ethdev.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_ip_frag.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_mbuf.h>
+#include <rte_per_lcore.h>
+#include <rte_spinlock.h>
+
+#include "udpdk_cksum.h"
+#include "udpdk_constants.h"
+#include "udpdk_frag.h"
+#include "udpdk_types.h"
+
+#define RTE_LOGTYPE_FRAG RTE_LOGTYPE_USER1
+
+extern configuration config;
+
+/* Fragmentation pools owned by the app threads, given back when a thread exits */
+static struct rte_mempool *frag_direct_pools[APP_FRAG_THREADS_MAX];
+static struct rte_mempool *frag_indirect_pools[APP_FRAG_THREADS_MAX];
+static bool frag_pools_taken[APP_FRAG_THREADS_MAX];
+static rte_spinlock_t frag_pools_lock = RTE_SPINLOCK_INITIALIZER;
+static rte_atomic32_t frag_pools_released = RTE_ATOMIC32_INIT(0);   // pools given back so far
+static pthread_key_t frag_pools_key;    // its destructor gives back the pools of an exiting thread
+
+/* Index of the fragmentation pools of this thread (-1: not assigned yet, -2: none left) */
+static RTE_DEFINE_PER_LCORE(int, frag_pools_idx) = -1;
+/* Value of frag_pools_released when this thread found no pools left (it tries again once some are released) */
+static RTE_DEFINE_PER_LCORE(int32_t, frag_pools_seen) = 0;
+
+/* Give back the fragmentation pools of a thread that exits */
+static void frag_pools_release(void *arg)
+{
+    int idx = (int)(intptr_t)arg - 1;
+
+    rte_spinlock_lock(&frag_pools_lock);
+    frag_pools_taken[idx] = false;
+    rte_spinlock_unlock(&frag_pools_lock);
+    rte_atomic32_inc(&frag_pools_released);
+}
+
+/* Take the first free pair of fragmentation pools; return its index, or -1 if none is left */
+static int frag_pools_take(void)
+{
+    int i, idx = -1;
+
+    rte_spinlock_lock(&frag_pools_lock);
+    for (i = 0; i < config.app_frag; i++) {
+        if (!frag_pools_taken[i]) {
+            frag_pools_taken[i] = true;
+            idx = i;
+            break;
+        }
+    }
+    rte_spinlock_unlock(&frag_pools_lock);
+    if (idx >= 0 && pthread_setspecific(frag_pools_key, (void *)(intptr_t)(idx + 1)) != 0) {
+        // Without the destructor the pools would never be given back, so do not keep them
+        frag_pools_release((void *)(intptr_t)(idx + 1));
+        idx = -1;
+    }
+    return idx;
+}
+
+/*
+ * Split a packet (Ethernet + IPv4) into fragments that fit in the MTU, ready to be sent.
+ * Return the number of fragments put in frags, or -1 on failure; the original packet is not freed.
+ */
+int udpdk_ipv4_fragment(struct rte_mbuf *pkt, struct rte_mbuf **frags, uint16_t nb_frags_max,
+        struct rte_mempool *direct_pool, struct rte_mempool *indirect_pool, uint64_t tx_offloads)
+{
+    struct rte_ether_hdr eth_hdr;
+    struct rte_ether_hdr *new_eth_hdr;
+    struct rte_ipv4_hdr *ip_hdr;
+    struct rte_mbuf *frag;
+    uint64_t ol_flags;
+    int n_frags;
+    int j;
+
+    // Save the Ethernet header and strip it (because fragmentation applies from IPv4 header)
+    rte_memcpy(&eth_hdr, rte_pktmbuf_mtod(pkt, const void *), sizeof(eth_hdr));
+    rte_pktmbuf_adj(pkt, (uint16_t)sizeof(struct rte_ether_hdr));
+    n_frags = rte_ipv4_fragment_packet(pkt, frags, nb_frags_max, config.mtu, direct_pool, indirect_pool);
+    rte_pktmbuf_prepend(pkt, (uint16_t)sizeof(struct rte_ether_hdr));
+    if (unlikely(n_frags < 0)) {
+        return -1;
+    }
+
+    // The header checksum must be recomputed (by the NIC if possible)
+    ol_flags = (tx_offloads & DEV_TX_OFFLOAD_IPV4_CKSUM) ? (PKT_TX_IPV4 | PKT_TX_IP_CKSUM) : 0;
+
+    // Re-attach (and adjust) the Ethernet header to each fragment
+    for (j = 0; j < n_frags; j++) {
+        frag = frags[j];
+        new_eth_hdr = (struct rte_ether_hdr *)rte_pktmbuf_prepend(frag, sizeof(struct rte_ether_hdr));
+        if (unlikely(new_eth_hdr == NULL)) {
+            RTE_LOG(ERR, FRAG, "mbuf has no room to rebuild the Ethernet header\n");
+            for (j = 0; j < n_frags; j++) {
+                rte_pktmbuf_free(frags[j]);
+            }
+            return -1;
+        }
+        rte_memcpy(new_eth_hdr, &eth_hdr, sizeof(eth_hdr));
+        frag->packet_type = RTE_PTYPE_L2_ETHER | RTE_PTYPE_L3_IPV4 | RTE_PTYPE_L4_UDP;
+        frag->ol_flags |= ol_flags;
+        frag->l2_len = sizeof(struct rte_ether_hdr);
+        frag->l3_len = sizeof(struct rte_ipv4_hdr);
+        if (ol_flags == 0) {
+            ip_hdr = (struct rte_ipv4_hdr *)(new_eth_hdr + 1);
+            ip_hdr->hdr_checksum = 0;
+            ip_hdr->hdr_checksum = udpdk_ipv4_cksum(ip_hdr);
+        }
+    }
+    return n_frags;
+}
+
+/* Create the fragmentation pools of the app threads (before the poller starts, so that it can free the mbufs) */
+int udpdk_frag_pools_init(void)
+{
+    char name[RTE_MEMPOOL_NAMESIZE];
+    const int socket = rte_socket_id();
+    int i;
+
+    if (config.app_frag > APP_FRAG_THREADS_MAX) {
+        RTE_LOG(WARNING, FRAG, "app_frag=%d exceeds the maximum, using %d\n", config.app_frag, APP_FRAG_THREADS_MAX);
+        config.app_frag = APP_FRAG_THREADS_MAX;
+    }
+    if (config.app_frag > 0 && pthread_key_create(&frag_pools_key, frag_pools_release) != 0) {
+        RTE_LOG(ERR, FRAG, "Failed to create the key of the fragmentation pools\n");
+        return -1;
+    }
+    for (i = 0; i < config.app_frag; i++) {
+        // The mbufs are allocated by one sending thread at a time, and freed by the poller (another process)
+        // after TX: without a per-lcore cache, they go straight back to the pool instead of the poller's cache
+        snprintf(name, sizeof(name), PKTMBUF_POOL_FRAG_DIRECT_NAME, i);
+        frag_direct_pools[i] = rte_pktmbuf_pool_create(name, APP_FRAG_POOL_SIZE, 0, 0,
+                RTE_MBUF_DEFAULT_BUF_SIZE, socket);
+        snprintf(name, sizeof(name), PKTMBUF_POOL_FRAG_INDIRECT_NAME, i);
+        frag_indirect_pools[i] = rte_pktmbuf_pool_create(name, APP_FRAG_POOL_SIZE, 0, 0, 0, socket);
+        if (frag_direct_pools[i] == NULL || frag_indirect_pools[i] == NULL) {
+            RTE_LOG(ERR, FRAG, "Failed to allocate fragmentation pools: %s\n", rte_strerror(rte_errno));
+            return -1;
+        }
+    }
+    RTE_LOG(INFO, FRAG, "Fragmentation in the sending threads enabled for up to %d threads\n", config.app_frag);
+    return 0;
+}
+
+/* Get the fragmentation pools of the calling thread, assigning them on first use (or once some are given back,
+ * if there were none left); return -1 if none is left */
+int udpdk_frag_pools_get(struct rte_mempool **direct_pool, struct rte_mempool **indirect_pool)
+{
+    int idx = RTE_PER_LCORE(frag_pools_idx);
+
+    if (unlikely(idx < 0) && (idx == -1
+            || rte_atomic32_read(&frag_pools_released) != RTE_PER_LCORE(frag_pools_seen))) {
+        RTE_PER_LCORE(frag_pools_seen) = rte_atomic32_read(&frag_pools_released);
+        idx = frag_pools_take();
+        if (idx < 0) {
+            idx = -2;
+        }
+        RTE_PER_LCORE(frag_pools_idx) = idx;
+    }
+    if (idx < 0) {
+        return -1;
+    }
+    *direct_pool = frag_direct_pools[idx];
+    *indirect_pool = frag_indirect_pools[idx];
+    return 0;
+}
@@ -0,0 +1,19 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+
+#ifndef UDPDK_FRAG_H
+#define UDPDK_FRAG_H
+
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+
+int udpdk_ipv4_fragment(struct rte_mbuf *pkt, struct rte_mbuf **frags, uint16_t nb_frags_max,
+        struct rte_mempool *direct_pool, struct rte_mempool *indirect_pool, uint64_t tx_offloads);
+
+int udpdk_frag_pools_init(void);
+
+int udpdk_frag_pools_get(struct rte_mempool **direct_pool, struct rte_mempool **indirect_pool);
+
+#endif  // UDPDK_FRAG_H
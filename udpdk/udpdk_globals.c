@@ -30,6 +30,15 @@ struct exch_zone_info *exch_zone_desc = NULL;
 
 struct exch_slot *exch_slots = NULL;
 
+struct udpdk_poller_stats *poller_stats = NULL;
+
+int udpdk_trace_offset = -1;
+
+int udpdk_tstamp_offset = -1;
+
+
+uint64_t udpdk_txtime_flag = 0;
+
 struct rte_ring *ipc_app_to_pol = NULL;
 
 struct rte_ring *ipc_pol_to_app = NULL;
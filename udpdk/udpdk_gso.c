@@ -0,0 +1,148 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+// Software UDP segmentation (for UDP_SEGMENT sends when the NIC lacks
+// DEV_TX_OFFLOAD_UDP_TSO). Unlike the UDP mode of librte_gso, which emits IP
+// fragments, each segment is a complete UDP datagram. The payload is not
+// copied: every datagram is a fresh header followed by indirect mbufs
+// attached to the segments of the original packet.
+//
+
+#include <rte_byteorder.h>
+#include <rte_common.h>
+#include <rte_ethdev.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+#include <rte_memcpy.h>
+#include <rte_udp.h>
+
+#include "udpdk_cksum.h"
+#include "udpdk_gso.h"
+
+/* Build a datagram header, copying the one of the original packet */
+static inline struct rte_mbuf *gso_build_header(const struct rte_mbuf *pkt, uint16_t hdr_len,
+        struct rte_mempool *direct_pool)
+{
+    struct rte_mbuf *hdr;
+    char *data;
+
+    hdr = rte_pktmbuf_alloc(direct_pool);
+    if (unlikely(hdr == NULL)) {
+        return NULL;
+    }
+    data = rte_pktmbuf_append(hdr, hdr_len);
+    rte_memcpy(data, rte_pktmbuf_mtod(pkt, const void *), hdr_len);
+    hdr->packet_type = pkt->packet_type;
+    hdr->l2_len = pkt->l2_len;
+    hdr->l3_len = pkt->l3_len;
+    hdr->l4_len = pkt->l4_len;
+    return hdr;
+}
+
+/* Append len bytes of payload, from the segment *src at offset *src_off, as indirect mbufs */
+static inline int gso_attach_payload(struct rte_mbuf *hdr, struct rte_mbuf **src, uint32_t *src_off,
+        uint32_t len, struct rte_mempool *indirect_pool)
+{
+    struct rte_mbuf *last = hdr;
+    struct rte_mbuf *ind;
+    uint32_t avail, take;
+
+    while (len > 0) {
+        avail = (*src)->data_len - *src_off;
+        if (avail == 0) {
+            *src = (*src)->next;
+            *src_off = 0;
+            continue;
+        }
+        take = RTE_MIN(avail, len);
+        ind = rte_pktmbuf_alloc(indirect_pool);
+        if (unlikely(ind == NULL)) {
+            return -1;
+        }
+        // Reference the original data, restricted to [src_off, src_off + take)
+        rte_pktmbuf_attach(ind, *src);
+        rte_pktmbuf_adj(ind, *src_off);
+        rte_pktmbuf_trim(ind, ind->data_len - take);
+        last->next = ind;
+        last = ind;
+        hdr->nb_segs++;
+        hdr->pkt_len += take;
+        *src_off += take;
+        len -= take;
+    }
+    return 0;
+}
+
+/*
+ * Split a packet marked with PKT_TX_UDP_SEG into datagrams of pkt->tso_segsz bytes of payload.
+ * Return the number of datagrams put in segs, or -1 on failure; the original packet is not freed.
+ */
+int udpdk_gso_segment(struct rte_mbuf *pkt, struct rte_mbuf **segs, uint16_t nb_segs_max,
+        struct rte_mempool *direct_pool, struct rte_mempool *indirect_pool,
+        uint64_t tx_offloads, bool no_check)
+{
+    struct rte_mbuf *src = pkt;
+    struct rte_mbuf *hdr;
+    struct rte_ipv4_hdr *ip_hdr;
+    struct rte_udp_hdr *udp_hdr;
+    uint16_t hdr_len = pkt->l2_len + pkt->l3_len + pkt->l4_len;
+    uint16_t gso_size = pkt->tso_segsz;
+    uint16_t ip_id;
+    uint32_t payload_left = pkt->pkt_len - hdr_len;
+    uint32_t src_off = hdr_len;
+    uint32_t seg_len;
+    uint16_t n_segs, s;
+
+    if (unlikely(gso_size == 0 || pkt->data_len < hdr_len)) {
+        return -1;
+    }
+    n_segs = (payload_left + gso_size - 1) / gso_size;
+    if (unlikely(n_segs > nb_segs_max)) {
+        return -1;
+    }
+    ip_id = rte_be_to_cpu_16(rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, pkt->l2_len)->packet_id);
+
+    for (s = 0; s < n_segs; s++) {
+        seg_len = RTE_MIN((uint32_t)gso_size, payload_left);
+        hdr = gso_build_header(pkt, hdr_len, direct_pool);
+        if (unlikely(hdr == NULL)) {
+            goto gso_fail;
+        }
+        segs[s] = hdr;
+        if (unlikely(gso_attach_payload(hdr, &src, &src_off, seg_len, indirect_pool) < 0)) {
+            s++;
+            goto gso_fail;
+        }
+        payload_left -= seg_len;
+
+        // Fix the headers of this datagram
+        ip_hdr = rte_pktmbuf_mtod_offset(hdr, struct rte_ipv4_hdr *, hdr->l2_len);
+        udp_hdr = rte_pktmbuf_mtod_offset(hdr, struct rte_udp_hdr *, hdr->l2_len + hdr->l3_len);
+        ip_hdr->total_length = rte_cpu_to_be_16(hdr->l3_len + hdr->l4_len + seg_len);
+        ip_hdr->packet_id = rte_cpu_to_be_16(ip_id + s);
+        ip_hdr->hdr_checksum = 0;
+        udp_hdr->dgram_len = rte_cpu_to_be_16(hdr->l4_len + seg_len);
+        udp_hdr->dgram_cksum = 0;
+        if (tx_offloads & DEV_TX_OFFLOAD_IPV4_CKSUM) {
+            hdr->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+        } else {
+            ip_hdr->hdr_checksum = udpdk_ipv4_cksum(ip_hdr);
+        }
+        if (!no_check) {
+            if (tx_offloads & DEV_TX_OFFLOAD_UDP_CKSUM) {
+                hdr->ol_flags |= PKT_TX_IPV4 | PKT_TX_UDP_CKSUM;
+                udp_hdr->dgram_cksum = rte_ipv4_phdr_cksum(ip_hdr, hdr->ol_flags);
+            } else {
+                udp_hdr->dgram_cksum = udpdk_udp_cksum(hdr, ip_hdr, udp_hdr, hdr->l2_len + hdr->l3_len);
+            }
+        }
+    }
+    return n_segs;
+
+gso_fail:
+    while (s > 0) {
+        rte_pktmbuf_free(segs[--s]);
+    }
+    return -1;
+}
@@ -0,0 +1,18 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+
+#ifndef UDPDK_GSO_H
+#define UDPDK_GSO_H
+
+#include <stdbool.h>
+
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+
+int udpdk_gso_segment(struct rte_mbuf *pkt, struct rte_mbuf **segs, uint16_t nb_segs_max,
+        struct rte_mempool *direct_pool, struct rte_mempool *indirect_pool,
+        uint64_t tx_offloads, bool no_check);
+
+#endif  // UDPDK_GSO_H
@@ -26,9 +26,14 @@
 #include "udpdk_args.h"
 #include "udpdk_constants.h"
 #include "udpdk_bind_table.h"
+#include "udpdk_frag.h"
 #include "udpdk_monitor.h"
 #include "udpdk_poller.h"
+#include "udpdk_stats.h"
 #include "udpdk_sync.h"
+#include "udpdk_timestamp.h"
+#include "udpdk_trace.h"
+#include "udpdk_txtime.h"
 #include "udpdk_types.h"
 
 #define RTE_LOGTYPE_INIT RTE_LOGTYPE_USER1
@@ -36,8 +41,9 @@
 #define RTE_LOGTYPE_INTR RTE_LOGTYPE_USER1
 
 extern int interrupted;
+extern configuration config;
 extern struct exch_zone_info *exch_zone_desc;
-extern struct exch_slot *exch_slots;
+extern struct udpdk_poller_stats *poller_stats;
 extern struct rte_mempool *rx_pktmbuf_pool;
 extern struct rte_mempool *tx_pktmbuf_pool;
 extern struct rte_mempool *tx_pktmbuf_direct_pool;
@@ -51,21 +57,11 @@ extern struct rte_ring *ipc_app_to_pol;
 extern struct rte_ring *ipc_pol_to_app;
 extern struct rte_mempool *ipc_msg_pool;
 static pid_t poller_pid;
+static bool rx_hw_tstamp = false;
+static uint64_t tx_offloads = 0;
+static uint16_t txq_prio = QUEUE_TX;
 
 
-/* Get the name of the rings of exchange slots */
-static inline const char * get_exch_ring_name(unsigned id, enum exch_ring_func func)
-{
-    static char buffer[sizeof(EXCH_RX_RING_NAME) + 8];
-
-    if (func == EXCH_RING_RX) {
-        snprintf(buffer, sizeof(buffer), EXCH_RX_RING_NAME, id);
-    } else {
-        snprintf(buffer, sizeof(buffer), EXCH_TX_RING_NAME, id);
-    }
-    return buffer;
-}
-
 /* Initialize a pool of mbuf for reception and transmission */
 static int init_mbuf_pools(void)
 {
@@ -74,16 +70,19 @@ static int init_mbuf_pools(void)
     const unsigned int num_mbufs_cache = 2 * MBUF_CACHE_SIZE;
     const unsigned int num_mbufs = num_mbufs_rx + num_mbufs_tx + num_mbufs_cache;
     const int socket = rte_socket_id();
+    // A full frame fits in a single mbuf (the direct and indirect pools only hold headers)
+    const uint16_t frame_buf_size = RTE_PKTMBUF_HEADROOM + RTE_MAX(RTE_MBUF_DEFAULT_DATAROOM,
+            config.mtu + RTE_ETHER_HDR_LEN + RTE_ETHER_CRC_LEN);
 
     rx_pktmbuf_pool = rte_pktmbuf_pool_create(PKTMBUF_POOL_RX_NAME, num_mbufs, MBUF_CACHE_SIZE, 0,
-            RTE_MBUF_DEFAULT_BUF_SIZE, socket);
+            frame_buf_size, socket);
     if (rx_pktmbuf_pool == NULL) {
         RTE_LOG(ERR, INIT, "Failed to allocate RX pool: %s\n", rte_strerror(rte_errno));
         return -1;
     }
 
     tx_pktmbuf_pool = rte_pktmbuf_pool_create(PKTMBUF_POOL_TX_NAME, num_mbufs, MBUF_CACHE_SIZE, 0,
-            RTE_MBUF_DEFAULT_BUF_SIZE, socket);  // used by the app (sendto) // TODO size properly
+            frame_buf_size, socket);  // used by the app (sendto) // TODO size properly
     if (tx_pktmbuf_pool == NULL) {
         RTE_LOG(ERR, INIT, "Failed to allocate TX pool: %s\n", rte_strerror(rte_errno));
         return -1;
@@ -112,10 +111,11 @@ static int init_port(uint16_t port_num)
     struct rte_eth_dev_info dev_info;
     // TODO add RSS support
     const uint16_t rx_rings = 1;
-    const uint16_t tx_rings = 1;
+    uint16_t tx_rings = 1;
     uint16_t rx_ring_size = NUM_RX_DESC_DEFAULT;
     uint16_t tx_ring_size = NUM_TX_DESC_DEFAULT;
     uint16_t q;
+    uint16_t mtu;
     int retval;
 
     // Check port validity
@@ -132,12 +132,13 @@ static int init_port(uint16_t port_num)
         return retval;
     }
 
-    const struct rte_eth_conf port_conf = {
+    struct rte_eth_conf port_conf = {
         .rxmode = {
             .mq_mode = ETH_MQ_RX_RSS,
-            .max_rx_pkt_len = RTE_MIN(JUMBO_FRAME_MAX_SIZE, dev_info.max_rx_pktlen),
+            .max_rx_pkt_len = RTE_MIN((uint32_t)(config.mtu + RTE_ETHER_HDR_LEN + RTE_ETHER_CRC_LEN),
+                                      dev_info.max_rx_pktlen),
             .split_hdr_size = 0,
-            .offloads = (DEV_RX_OFFLOAD_CHECKSUM |
+            .offloads = ((DEV_RX_OFFLOAD_CHECKSUM & dev_info.rx_offload_capa) |
                          DEV_RX_OFFLOAD_SCATTER |
                          DEV_RX_OFFLOAD_JUMBO_FRAME),
         },
@@ -146,6 +147,38 @@ static int init_port(uint16_t port_num)
         }
     };
 
+    // Offload the IPv4 and UDP checksums, and the UDP segmentation, to the NIC if supported
+    if (port_num == PORT_TX) {
+        tx_offloads = dev_info.tx_offload_capa &
+                (DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_UDP_CKSUM | DEV_TX_OFFLOAD_UDP_TSO);
+        port_conf.txmode.offloads |= tx_offloads;
+        RTE_LOG(INFO, INIT, "Checksums on port %d: IPv4 %s, UDP %s\n", port_num,
+                (tx_offloads & DEV_TX_OFFLOAD_IPV4_CKSUM) ? "offloaded" : "software",
+                (tx_offloads & DEV_TX_OFFLOAD_UDP_CKSUM) ? "offloaded" : "software");
+        RTE_LOG(INFO, INIT, "UDP segmentation on port %d: %s\n", port_num,
+                (tx_offloads & DEV_TX_OFFLOAD_UDP_TSO) ? "offloaded" : "software");
+    }
+
+    // Enable the NIC timestamps, if requested and supported
+    if (config.rx_timestamp == UDPDK_TSTAMP_HARDWARE && port_num == PORT_RX) {
+        if (dev_info.rx_offload_capa & DEV_RX_OFFLOAD_TIMESTAMP) {
+            port_conf.rxmode.offloads |= DEV_RX_OFFLOAD_TIMESTAMP;
+            rx_hw_tstamp = true;
+        } else {
+            RTE_LOG(WARNING, INIT, "Port %d does not support RX timestamps, using software ones\n", port_num);
+        }
+    }
+
+    // Add a TX queue for the high-priority sockets, so that their packets do not wait behind the bulk ones
+    if (config.prio_txq && port_num == PORT_TX) {
+        if (dev_info.max_tx_queues > QUEUE_TX_PRIO) {
+            tx_rings = QUEUE_TX_PRIO + 1;
+            txq_prio = QUEUE_TX_PRIO;
+        } else {
+            RTE_LOG(WARNING, INIT, "Port %d has a single TX queue, high-priority sockets will share it\n", port_num);
+        }
+    }
+
     // Configure mode and number of rings
     retval = rte_eth_dev_configure(port_num, rx_rings, tx_rings, &port_conf);
     if (retval != 0) {
@@ -153,6 +186,19 @@ static int init_port(uint16_t port_num)
         return retval;
     }
 
+    // Set the MTU (the frames up to this size are sent and received without fragmentation)
+    if (config.mtu > dev_info.max_mtu) {
+        RTE_LOG(ERR, INIT, "MTU %d is not supported by port %d (max %u)\n", config.mtu, port_num, dev_info.max_mtu);
+        return -EINVAL;
+    }
+    retval = rte_eth_dev_set_mtu(port_num, config.mtu);
+    if (retval != 0) {
+        RTE_LOG(ERR, INIT, "Could not set MTU %d on port %d: %s\n", config.mtu, port_num, strerror(-retval));
+        return retval;
+    }
+    rte_eth_dev_get_mtu(port_num, &mtu);
+    RTE_LOG(INFO, INIT, "MTU of port %d: %u\n", port_num, mtu);
+
     // Adjust the number of descriptors
     retval = rte_eth_dev_adjust_nb_rx_tx_desc(port_num, &rx_ring_size, &tx_ring_size);
     if (retval != 0) {
@@ -210,6 +256,8 @@ static int init_exch_memzone(void)
     }
     memset(mz->addr, 0, sizeof(*exch_zone_desc));
     exch_zone_desc = mz->addr;
+    exch_zone_desc->tx_offloads = tx_offloads;
+    exch_zone_desc->txq_prio = txq_prio;
 
     return 0;
 }
@@ -222,6 +270,30 @@ static int destroy_exch_memzone(void)
     return rte_memzone_free(mz);
 }
 
+/* Initialize a shared memory region to store the counters of the poller */
+static int init_poller_stats_memzone(void)
+{
+    const struct rte_memzone *mz;
+
+    mz = rte_memzone_reserve(POLLER_STATS_MEMZONE_NAME, sizeof(*poller_stats), rte_socket_id(), 0);
+    if (mz == NULL) {
+        RTE_LOG(ERR, INIT, "Cannot allocate shared memory for poller statistics\n");
+        return -1;
+    }
+    memset(mz->addr, 0, sizeof(*poller_stats));
+    poller_stats = mz->addr;
+
+    return 0;
+}
+
+static int destroy_poller_stats_memzone(void)
+{
+    const struct rte_memzone *mz;
+
+    mz = rte_memzone_lookup(POLLER_STATS_MEMZONE_NAME);
+    return rte_memzone_free(mz);
+}
+
 /* Initialize a shared memory region to store the L4 switching table */
 static int init_udp_bind_table(void)
 {
@@ -248,36 +320,6 @@ static int destroy_udp_bind_table(void)
     return rte_memzone_free(mz);
 }
 
-/* Initialize (statically) the slots to exchange packets between the application and the poller */
-static int init_exchange_slots(void)
-{
-    unsigned i;
-    unsigned socket_id;
-    const char *q_name;
-
-    socket_id = rte_socket_id();
-
-    // Allocate enough memory to store the exchange slots
-    exch_slots = rte_malloc(EXCH_SLOTS_NAME, sizeof(*exch_slots) * NUM_SOCKETS_MAX, 0);
-    if (exch_slots == NULL) {
-        RTE_LOG(ERR, INIT, "Cannot allocate memory for exchange slots\n");
-        return -1;
-    }
-
-    // Create a rte_ring for each RX and TX slot
-    for (i = 0; i < NUM_SOCKETS_MAX; i++) {
-        q_name = get_exch_ring_name(i, EXCH_RING_RX);
-        exch_slots[i].rx_q = rte_ring_create(q_name, EXCH_RING_SIZE, socket_id, RING_F_SP_ENQ | RING_F_SC_DEQ);
-        q_name = get_exch_ring_name(i, EXCH_RING_TX);
-        exch_slots[i].tx_q = rte_ring_create(q_name, EXCH_RING_SIZE, socket_id, RING_F_SP_ENQ | RING_F_SC_DEQ);
-        if (exch_slots[i].rx_q == NULL || exch_slots[i].tx_q == NULL) {
-            RTE_LOG(ERR, INIT, "Cannot create exchange RX/TX exchange rings (index %d)\n", i);
-            return -1;
-        }
-    }
-    return 0;
-}
-
 /* Initialize UDPDK */
 int udpdk_init(int argc, char *argv[])
 {
@@ -307,6 +349,10 @@ int udpdk_init(int argc, char *argv[])
             RTE_LOG(ERR, INIT, "Cannot initialize pools of mbufs\n");
             return -1;
         }
+        if (config.app_frag > 0 && udpdk_frag_pools_init() < 0) {
+            RTE_LOG(ERR, INIT, "Cannot initialize pools of mbufs for fragmentation\n");
+            return -1;
+        }
 
         // Initialize DPDK ports
         retval = init_port(PORT_RX);
@@ -341,18 +387,42 @@ int udpdk_init(int argc, char *argv[])
             return -1;
         }
 
+        // Initialize memzone for poller statistics
+        retval = init_poller_stats_memzone();
+        if (retval < 0) {
+            RTE_LOG(ERR, INIT, "Cannot initialize memzone for poller statistics\n");
+            return -1;
+        }
+
         retval = init_udp_bind_table();
         if (retval < 0) {
             RTE_LOG(ERR, INIT, "Cannot create table for UDP port switching\n");
             return -1;
         }
 
-        retval = init_exchange_slots();
-        if (retval < 0) {
-            RTE_LOG(ERR, INIT, "Cannot initialize exchange slots\n");
+        // Register the mbuf field for RX timestamps, and calibrate the clocks
+        if (config.rx_timestamp != UDPDK_TSTAMP_NONE) {
+            if (udpdk_tstamp_init() < 0 || udpdk_clock_init(PORT_RX, rx_hw_tstamp) < 0) {
+                RTE_LOG(ERR, INIT, "Cannot initialize RX timestamps\n");
+                return -1;
+            }
+        }
+
+        // Register the mbuf field for latency tracing (before the poller starts)
+        if (config.latency_trace && udpdk_trace_init() < 0) {
+            RTE_LOG(ERR, INIT, "Cannot initialize latency tracing\n");
+            return -1;
+        }
+
+        // Register the mbuf field and flag for launch times (before the poller starts)
+        if (config.txtime && udpdk_txtime_init() < 0) {
+            RTE_LOG(ERR, INIT, "Cannot initialize scheduled transmissions\n");
             return -1;
         }
 
+        // Expose the statistics through telemetry
+        udpdk_stats_telemetry_init();
+
         // Let the poller process resume initialization
         ipc_notify_to_poller();
         
@@ -381,7 +451,7 @@ void udpdk_interrupt(int signum)
 static void udpdk_close_all_sockets(void)
 {
     for (int s = 0; s < NUM_SOCKETS_MAX; s++) {
-        if (exch_zone_desc->slots[s].bound) {
+        if (exch_zone_desc->slots[s].used) {
             RTE_LOG(INFO, CLOSE, "Closing socket %d that was left open\n", s);
             udpdk_close(s);
         }
@@ -403,6 +473,10 @@ void udpdk_cleanup(void)
     } else {
         RTE_LOG(INFO, CLOSE, "...killed!\n");
     }
+    // Sockets closed from now on do not wait for the poller
+    if (exch_zone_desc != NULL) {
+        __atomic_store_n(&exch_zone_desc->poller_running, 0, __ATOMIC_SEQ_CST);
+    }
 
     // Stop and close DPDK ports
     RTE_ETH_FOREACH_DEV(port_id) {
@@ -419,6 +493,9 @@ void udpdk_cleanup(void)
     // Free the memory for exch zone
     destroy_exch_memzone();
 
+    // Free the memory for poller statistics
+    destroy_poller_stats_memzone();
+
     // Release linked-list memory allocators
     udpdk_list_deinit();
 }
@@ -6,11 +6,13 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <rte_common.h>
 #include <rte_eal.h>
+#include <rte_errno.h>
 #include <rte_ether.h>
 #include <rte_ethdev.h>
 #include <rte_ip_frag.h>
@@ -26,18 +28,59 @@
 
 #include "udpdk_constants.h"
 #include "udpdk_bind_table.h"
-#include "udpdk_dump.h"
+#include "udpdk_cksum.h"
+#include "udpdk_frag.h"
+#include "udpdk_rx_parse.h"
+#include "udpdk_gso.h"
+#include "udpdk_ratelimit.h"
 #include "udpdk_shmalloc.h"
 #include "udpdk_sync.h"
+#include "udpdk_timestamp.h"
+#include "udpdk_trace.h"
+#include "udpdk_txtime.h"
 #include "udpdk_types.h"
 
 #define RTE_LOGTYPE_POLLBODY RTE_LOGTYPE_USER1
 #define RTE_LOGTYPE_POLLINIT RTE_LOGTYPE_USER1
 #define RTE_LOGTYPE_POLLINTR RTE_LOGTYPE_USER1
 
+/* Log from the packet path, dropping the messages that exceed POLLER_LOG_RATE */
+#define POLLER_LOG_RL(l, t, ...) \
+    do { if (tb_consume(&log_tb, 1, rte_rdtsc())) RTE_LOG(l, t, __VA_ARGS__); } while (0)
+
+/* Cycle accounting: the time since the previous mark is charged to the given stage */
+#ifdef UDPDK_POLLER_PROFILE
+static uint64_t prof_tsc;
+#define PROF_START(now) (prof_tsc = (now))
+#define PROF_MARK(stage) \
+    do { \
+        uint64_t now = rte_rdtsc(); \
+        poller_stats->profile.stage_cycles[stage] += now - prof_tsc; \
+        prof_tsc = now; \
+    } while (0)
+#define PROF_LOOP_END(start, busy) \
+    do { \
+        if (busy) { \
+            poller_stats->profile.loops_busy++; \
+            poller_stats->profile.cycles_busy += prof_tsc - (start); \
+        } else { \
+            poller_stats->profile.loops_empty++; \
+            poller_stats->profile.cycles_empty += prof_tsc - (start); \
+        } \
+    } while (0)
+#else
+#define PROF_START(now) do {} while (0)
+#define PROF_MARK(stage) do {} while (0)
+#define PROF_LOOP_END(start, busy) do { (void)(busy); } while (0)
+#endif
+
 static volatile int poller_alive = 1;
 
+static struct token_bucket log_tb;
+
+extern configuration config;
 extern struct exch_zone_info *exch_zone_desc;
+extern struct udpdk_poller_stats *poller_stats;
 extern struct exch_slot *exch_slots;
 extern udpdk_list_t **sock_bind_table;
 extern const void *bind_info_alloc;
@@ -55,6 +98,7 @@ struct rx_queue {
 
 struct tx_queue {
     struct rte_mbuf *tx_mbuf_table[TX_MBUF_TABLE_SIZE];
+    struct rte_mbuf *tx_prio_mbuf_table[TX_MBUF_TABLE_SIZE];    // packets of the high-priority sockets
     struct rte_mempool *direct_pool;
     struct rte_mempool *indirect_pool;
 };
@@ -68,6 +112,35 @@ struct lcore_queue_conf {
 
 static struct lcore_queue_conf lcore_queue_conf[RTE_MAX_LCORE];
 
+// Worst-case mbufs put in the death row by one reassembly (a stale datagram and the current one)
+#define DEATH_ROW_SLACK     (2 * (RTE_LIBRTE_IP_FRAG_MAX_FRAG + 1))
+
+/* Fragments received from a source (hashed) in the current window (frag_max_per_src) */
+struct frag_src_slot {
+    uint64_t window_start;
+    uint32_t count;
+};
+
+static struct frag_src_slot frag_srcs[1 << FRAG_SRC_SLOTS_LOG2];
+static uint64_t frag_src_window;        // length of the window (cycles), as the reassembly timeout
+
+static udpdk_rx_parse_t rx_parse;       // parser of the headers of RX bursts
+
+/* State of the TX flush policy */
+struct tx_flush_state {
+    uint64_t deadline;      // TSC by which the oldest packet in the TX table must be sent (0: none waiting)
+    uint64_t window_end;    // end of the current window of the TX rate estimation (adaptive)
+    uint64_t window_pkts;   // packets dequeued in the current window
+    bool under_load;        // the last window dequeued at least tx_burst packets
+};
+
+static uint64_t tx_flush_cycles;        // tx_flush_us in TSC cycles
+static uint64_t rxq_hold_cycles;        // rxq_hold_ms in TSC cycles
+static unsigned tx_n_pending;           // packets held back by the TX scheduler (DRR or rate limits)
+static uint64_t rx_staged[NUM_SOCKETS_MAX / 64];    // bitmap of the sockets with packets in their rx_buffer
+
+static struct txtime_wheel txtime_wheel;    // packets waiting for their launch time (SO_TXTIME)
+
 
 /* Poller signal handler */
 static void poller_sighandler(int sig)
@@ -76,19 +149,6 @@ static void poller_sighandler(int sig)
     poller_alive = 0;
 }
 
-/* Get the name of the rings of exchange slots */
-static inline const char * get_exch_ring_name(unsigned id, enum exch_ring_func func)
-{
-    static char buffer[sizeof(EXCH_RX_RING_NAME) + 8];
-
-    if (func == EXCH_RING_RX) {
-        snprintf(buffer, sizeof(buffer), EXCH_RX_RING_NAME, id);
-    } else {
-        snprintf(buffer, sizeof(buffer), EXCH_TX_RING_NAME, id);
-    }
-    return buffer;
-}
-
 /* Initialize the allocators */
 static int setup_allocators(void)
 {
@@ -116,7 +176,10 @@ static int setup_queues(void)
     lcore_id = rte_lcore_id();
     socket_id = rte_socket_id();
     qconf = &lcore_queue_conf[lcore_id];
-    frag_cycles = (rte_get_tsc_hz() + MS_PER_S - 1) / MS_PER_S * MAX_FLOW_TTL;
+    frag_cycles = (rte_get_tsc_hz() + MS_PER_S - 1) / MS_PER_S * config.frag_ttl_ms;
+    frag_src_window = frag_cycles;
+    tx_flush_cycles = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * config.tx_flush_us;
+    rxq_hold_cycles = (rte_get_tsc_hz() + MS_PER_S - 1) / MS_PER_S * config.rxq_hold_ms;
 
     // Pool of mbufs for RX
     // NOTE actually unused because pool is needed only to initialize a queue, which is done in 'application' anyway
@@ -126,14 +189,18 @@ static int setup_queues(void)
         return -1;
     }
 
-    // Fragment table
-    qconf->rx_queue.frag_tbl = rte_ip_frag_table_create(NUM_FLOWS_DEF, IP_FRAG_TBL_BUCKET_ENTRIES,
-            NUM_FLOWS_MAX, frag_cycles, socket_id);
-    if (qconf->rx_queue.frag_tbl == NULL) {
-        RTE_LOG(ERR, POLLINIT, "ip_frag_tbl_create(%u) on lcore %u failed\n", NUM_FLOWS_DEF, lcore_id);
-        return -1;
+    // Fragment table (not needed if reassembly is disabled)
+    if (config.rx_reasm) {
+        qconf->rx_queue.frag_tbl = rte_ip_frag_table_create(config.frag_buckets, config.frag_bucket_entries,
+                config.frag_max_entries, frag_cycles, socket_id);
+        if (qconf->rx_queue.frag_tbl == NULL) {
+            RTE_LOG(ERR, POLLINIT, "ip_frag_tbl_create(%d) on lcore %u failed\n", config.frag_buckets, lcore_id);
+            return -1;
+        }
+        RTE_LOG(INFO, POLLINIT, "Created IP fragmentation table (%d buckets of %d entries, max %d datagrams, "
+                "timeout %d ms)\n", config.frag_buckets, config.frag_bucket_entries, config.frag_max_entries,
+                config.frag_ttl_ms);
     }
-    RTE_LOG(INFO, POLLINIT, "Created IP fragmentation table\n");
 
     // Pool of direct mbufs for TX
     qconf->tx_queue.direct_pool = rte_mempool_lookup(PKTMBUF_POOL_DIRECT_TX_NAME);
@@ -155,7 +222,6 @@ static int setup_queues(void)
 /* Setup the data structures needed to exchange packets with the app */
 static int setup_exch_zone(void)
 {
-    uint16_t i;
     const struct rte_memzone *mz;
 
     // Retrieve the exchange zone descriptor in shared memory
@@ -173,21 +239,31 @@ static int setup_exch_zone(void)
         return -1;
     }
 
-    for (i = 0; i < NUM_SOCKETS_MAX; i++) {
-        // Retrieve the RX queue for each slot
-        exch_slots[i].rx_q = rte_ring_lookup(get_exch_ring_name(i, EXCH_RING_RX));
-        if (exch_slots[i].rx_q == NULL) {
-            RTE_LOG(ERR, POLLINIT, "Failed to retrieve rx ring queue for exchanger %u\n", i);
-            return -1;
-        }
-        // Retrieve the TX queue for each slot
-        exch_slots[i].tx_q = rte_ring_lookup(get_exch_ring_name(i, EXCH_RING_TX));
-        if (exch_slots[i].tx_q == NULL) {
-            RTE_LOG(ERR, POLLINIT, "Failed to retrieve tx ring queue for exchanger %u\n", i);
-            return -1;
-        }
-        // rx_buffer and rx_count are already zeroed thanks to zmalloc
+    // rx_buffer and rx_count are already zeroed thanks to zmalloc
+    // NOTE: the RX/TX rings are created by the app on 'socket' and referenced by the slot descriptors
+
+    return 0;
+}
+
+/* Retrieve the poller counters (in shared memory, initialized by the primary) */
+static int setup_poller_stats(void)
+{
+    const struct rte_memzone *mz;
+
+    mz = rte_memzone_lookup(POLLER_STATS_MEMZONE_NAME);
+    if (mz == NULL) {
+        RTE_LOG(ERR, POLLINIT, "Cannot retrieve poller statistics memzone\n");
+        return -1;
     }
+    poller_stats = mz->addr;
+
+    // Rate limit of the messages logged on the packet path
+    tb_init(&log_tb, POLLER_LOG_RATE, POLLER_LOG_BURST);
+
+#ifdef UDPDK_POLLER_PROFILE
+    poller_stats->profile.tsc_hz = rte_get_tsc_hz();
+    RTE_LOG(INFO, POLLINIT, "Cycle accounting enabled\n");
+#endif
 
     return 0;
 }
@@ -211,6 +287,7 @@ static int setup_udp_table(void)
 int poller_init(int argc, char *argv[])
 {
     int retval;
+    enum udpdk_rx_parser parser;
 
     // Initialize EAL
     retval = rte_eal_init(argc, argv);
@@ -258,6 +335,13 @@ int poller_init(int argc, char *argv[])
         return -1;
     }
 
+    // Setup counters
+    retval = setup_poller_stats();
+    if (retval < 0) {
+        RTE_LOG(ERR, POLLINIT, "Cannot setup statistics for poller\n");
+        return -1;
+    }
+
     // Setup table for UDP port switching
     retval = setup_udp_table();
     if (retval < 0) {
@@ -265,36 +349,372 @@ int poller_init(int argc, char *argv[])
         return -1;
     }
 
+    // Select the parser of the RX headers
+    parser = config.rx_parser;
+    rx_parse = udpdk_rx_parse_select(&parser);
+    if (rx_parse == NULL) {
+        RTE_LOG(ERR, POLLINIT, "The CPU does not support the %s RX parser\n", udpdk_rx_parser_name(parser));
+        return -1;
+    }
+    RTE_LOG(INFO, POLLINIT, "Using the %s RX parser\n", udpdk_rx_parser_name(parser));
+
+    // Retrieve the mbuf field for RX timestamps (registered by the primary)
+    if (config.rx_timestamp != UDPDK_TSTAMP_NONE && udpdk_tstamp_init() < 0) {
+        RTE_LOG(ERR, POLLINIT, "Cannot setup RX timestamps for poller\n");
+        return -1;
+    }
+
+    // Retrieve the mbuf field for latency tracing (registered by the primary)
+    if (config.latency_trace && udpdk_trace_init() < 0) {
+        RTE_LOG(ERR, POLLINIT, "Cannot setup latency tracing for poller\n");
+        return -1;
+    }
+
+    // Retrieve the mbuf field and flag for launch times (registered by the primary), and start the timer wheel
+    if (config.txtime) {
+        if (udpdk_txtime_init() < 0) {
+            RTE_LOG(ERR, POLLINIT, "Cannot setup scheduled transmissions for poller\n");
+            return -1;
+        }
+        txtime_wheel_init(&txtime_wheel,
+                RTE_MAX(rte_get_tsc_hz() * config.txtime_tick_ns / NS_PER_S, 1), rte_rdtsc());
+    }
+
     // Notify the primary about the successful initialization
     ipc_notify_to_app();
 
     return 0;
 }
 
-static void flush_rx_queue(uint16_t idx)
+/* Stamp the packets about to be enqueued in a socket RX ring, saving how long they stayed in the poller */
+static inline void trace_rx_stamp(struct rte_mbuf **pkts, uint16_t n, uint64_t *lat)
+{
+    struct udpdk_mbuf_trace *trace;
+    uint64_t now = rte_rdtsc();
+    uint16_t j;
+
+    for (j = 0; j < n; j++) {
+        trace = udpdk_mbuf_trace(pkts[j]);
+        lat[j] = udpdk_trace_elapsed(trace, now);
+        trace->tsc = (uint32_t)now;
+    }
+}
+
+/* Account the time spent in the poller by the packets actually delivered to a socket */
+static inline void trace_rx_account(struct exch_slot_info *slot_info, const uint64_t *lat, uint16_t n)
+{
+    uint16_t j;
+
+    for (j = 0; j < n; j++) {
+        udpdk_lat_record(&slot_info->latency[UDPDK_LAT_RX_POLLER], lat[j]);
+    }
+}
+
+/* Timestamp the packets just received from the NIC (software RX timestamp) */
+static inline void tstamp_rx_burst(struct rte_mbuf **pkts, uint16_t n)
+{
+    uint64_t now = rte_rdtsc();
+    uint16_t j;
+
+    for (j = 0; j < n; j++) {
+        *udpdk_mbuf_rx_tsc(pkts[j]) = now;
+    }
+}
+
+/* Stamp the packets just received from the NIC */
+static inline void trace_rx_burst(struct rte_mbuf **pkts, uint16_t n)
 {
+    uint64_t now = rte_rdtsc();
     uint16_t j;
+
+    for (j = 0; j < n; j++) {
+        udpdk_mbuf_trace(pkts[j])->tsc = (uint32_t)now;
+    }
+}
+
+/* Stamp a packet dequeued from a socket TX ring, and account how long it waited there
+ * (unless it is not the first fragment of a datagram fragmented by the sending thread) */
+static inline void trace_tx_dequeue(struct rte_mbuf *pkt, int sockfd, uint64_t now)
+{
+    struct udpdk_mbuf_trace *trace = udpdk_mbuf_trace(pkt);
+
+    if (trace->sockfd < 0) {
+        return;
+    }
+    udpdk_lat_record(&exch_zone_desc->slots[sockfd].latency[UDPDK_LAT_TX_QUEUE], udpdk_trace_elapsed(trace, now));
+    trace->tsc = (uint32_t)now;
+}
+
+/* Account the time spent in the poller by the packets about to be sent */
+static inline void trace_tx_burst(struct rte_mbuf **pkts, uint16_t n)
+{
+    struct udpdk_mbuf_trace *trace;
+    uint64_t now = rte_rdtsc();
+    uint16_t j;
+
+    for (j = 0; j < n; j++) {
+        trace = udpdk_mbuf_trace(pkts[j]);
+        if (trace->sockfd >= 0) {
+            udpdk_lat_record(&exch_zone_desc->slots[trace->sockfd].latency[UDPDK_LAT_TX_POLLER],
+                    udpdk_trace_elapsed(trace, now));
+        }
+    }
+}
+
+#define GRO_HDR_LEN (sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr))
+
+/* Check if two datagrams belong to the same flow (4-tuple) */
+static inline bool gro_same_flow(const struct rte_ipv4_hdr *ip_a, const struct rte_udp_hdr *udp_a,
+                                 const struct rte_ipv4_hdr *ip_b, const struct rte_udp_hdr *udp_b)
+{
+    return (ip_a->src_addr == ip_b->src_addr) && (ip_a->dst_addr == ip_b->dst_addr)
+            && (udp_a->src_port == udp_b->src_port) && (udp_a->dst_port == udp_b->dst_port);
+}
+
+/* Finish a coalesced datagram: its headers describe the whole payload, and the segment size is annotated */
+static inline void gro_close(struct rte_mbuf *head, uint16_t n_segs, uint16_t seg_len, uint32_t payl_len)
+{
+    struct rte_ipv4_hdr *ip_hdr;
+    struct rte_udp_hdr *udp_hdr;
+
+    if (n_segs < 2)
+        return;
+    ip_hdr = rte_pktmbuf_mtod_offset(head, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+    udp_hdr = (struct rte_udp_hdr *)(ip_hdr + 1);
+    ip_hdr->total_length = rte_cpu_to_be_16(sizeof(*ip_hdr) + sizeof(*udp_hdr) + payl_len);
+    ip_hdr->hdr_checksum = 0;
+    ip_hdr->hdr_checksum = udpdk_ipv4_cksum(ip_hdr);
+    udp_hdr->dgram_len = rte_cpu_to_be_16(sizeof(*udp_hdr) + payl_len);
+    udp_hdr->dgram_cksum = 0;   // each datagram was verified on reception
+    // The TX offload fields are unused on RX, so the segment size is kept where UDP_SEGMENT puts it
+    head->tso_segsz = seg_len;
+}
+
+/*
+ * Coalesce the consecutive datagrams of the same flow and size into a single one, chaining their payloads
+ * (UDP_GRO, as in Linux: the last datagram of a train may be shorter); return the new number of packets
+ */
+static uint16_t gro_coalesce(struct exch_slot_info *slot_info, struct rte_mbuf **pkts, uint16_t n)
+{
+    struct rte_mbuf *head = NULL;
+    struct rte_mbuf *m;
+    struct rte_ipv4_hdr *head_ip = NULL, *ip_hdr;
+    struct rte_udp_hdr *head_udp = NULL, *udp_hdr;
+    uint32_t head_payl = 0;     // payload of the train so far
+    uint16_t seg_len = 0;       // payload of each datagram of the train
+    uint16_t n_segs = 0;        // datagrams in the train
+    uint16_t payl_len;
+    uint16_t i, n_out = 0;
+
+    for (i = 0; i < n; i++) {
+        m = pkts[i];
+        ip_hdr = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+        udp_hdr = (struct rte_udp_hdr *)(ip_hdr + 1);
+        payl_len = rte_be_to_cpu_16(udp_hdr->dgram_len) - sizeof(struct rte_udp_hdr);
+
+        // Only the datagrams without IP options nor Ethernet padding can be coalesced
+        if ((ip_hdr->version_ihl & RTE_IPV4_HDR_IHL_MASK) * RTE_IPV4_IHL_MULTIPLIER == sizeof(struct rte_ipv4_hdr)
+                && m->pkt_len == GRO_HDR_LEN + payl_len) {
+            // Append to the current train (unless already coalesced, if held back by backpressure)
+            if (head != NULL && m->tso_segsz == 0 && payl_len <= seg_len && n_segs < GRO_MAX_SEGS
+                    && head_payl + payl_len <= UDP_MAX_PAYLOAD
+                    && gro_same_flow(head_ip, head_udp, ip_hdr, udp_hdr)) {
+                rte_pktmbuf_adj(m, GRO_HDR_LEN);
+                if (likely(rte_pktmbuf_chain(head, m) == 0)) {
+                    n_segs++;
+                    head_payl += payl_len;
+                    slot_info->stats.rx_gro_merged++;
+                    // A shorter datagram ends the train
+                    if (payl_len < seg_len) {
+                        gro_close(head, n_segs, seg_len, head_payl);
+                        head = NULL;
+                    }
+                    continue;
+                }
+                rte_pktmbuf_prepend(m, GRO_HDR_LEN);
+            }
+        } else {
+            payl_len = 0;
+        }
+
+        // Otherwise, close the current train and start a new one from this datagram
+        if (head != NULL) {
+            gro_close(head, n_segs, seg_len, head_payl);
+        }
+        pkts[n_out++] = m;
+        // The headers of the first datagram are rewritten, so it must not be shared with other sockets
+        // (nor already coalesced, if held back by backpressure)
+        if (payl_len > 0 && m->tso_segsz == 0 && RTE_MBUF_DIRECT(m) && rte_mbuf_refcnt_read(m) == 1) {
+            head = m;
+            head_ip = ip_hdr;
+            head_udp = udp_hdr;
+            head_payl = payl_len;
+            seg_len = payl_len;
+            n_segs = 1;
+        } else {
+            head = NULL;
+        }
+    }
+    if (head != NULL) {
+        gro_close(head, n_segs, seg_len, head_payl);
+    }
+    return n_out;
+}
+
+/* Move the packets received for a socket to its RX ring; return the number of packets held back */
+static uint16_t flush_rx_queue(uint16_t idx)
+{
+    uint16_t j;
+    uint16_t n_enq, n_left, n_old;
     struct rte_ring *rx_q;
+    struct exch_slot *slot = &exch_slots[idx];
+    struct exch_slot_info *slot_info = &exch_zone_desc->slots[idx];
+    struct rte_mbuf *old_pkts[EXCH_BUF_SIZE];
+    uint64_t rx_lat[EXCH_BUF_SIZE];
 
     // Skip if no packets received
-    if (exch_slots[idx].rx_count == 0)
-        return;
+    if (slot->rx_count == 0)
+        return 0;
+
+    // Get a reference to the appropriate ring in shared memory
+    rx_q = slot_info->rx_q;
 
-    // Get a reference to the appropriate ring in shared memory (lookup by name)
-    rx_q = exch_slots[idx].rx_q;
+    // Coalesce the datagrams of the same flow
+    if (slot_info->gro) {
+        slot->rx_count = gro_coalesce(slot_info, slot->rx_buffer, slot->rx_count);
+    }
 
-    // Put the packets in the ring
-    if (rte_ring_enqueue_bulk(rx_q, (void **)exch_slots[idx].rx_buffer, exch_slots[idx].rx_count, NULL) == 0) {
-        for (j = 0; j < exch_slots[idx].rx_count; j++)
-            rte_pktmbuf_free(exch_slots[idx].rx_buffer[j]);
+    // Stamp the packets (before they are visible to the app, which may free them as soon as enqueued)
+    if (udpdk_trace_enabled()) {
+        trace_rx_stamp(slot->rx_buffer, slot->rx_count, rx_lat);
     }
-    exch_slots[idx].rx_count = 0;
+
+    // Put as many packets as possible in the ring
+    n_enq = rte_ring_enqueue_burst(rx_q, (void **)slot->rx_buffer, slot->rx_count, NULL);
+    n_left = slot->rx_count - n_enq;
+
+    // Handle the packets that didn't fit according to the socket policy
+    if (unlikely(n_left > 0)) {
+        switch (slot_info->rxq_policy) {
+            case UDPDK_RXQ_DROP_HEAD:
+                // Evict the oldest packets in the ring to make room for the new ones
+                n_old = rte_ring_mc_dequeue_burst(rx_q, (void **)old_pkts, n_left, NULL);
+                for (j = 0; j < n_old; j++)
+                    rte_pktmbuf_free(old_pkts[j]);
+                slot_info->stats.rx_dropped_full += n_old;
+                n_enq += rte_ring_enqueue_burst(rx_q, (void **)&slot->rx_buffer[n_enq], n_left, NULL);
+                n_left = slot->rx_count - n_enq;
+                break;
+            case UDPDK_RXQ_BACKPRESSURE:
+                // Do not let a consumer that stopped reading block RX for all the sockets: after rxq_hold_ms,
+                // drop the packets that don't fit until its ring has room again
+                if (unlikely(slot->rx_hold_expired)) {
+                    break;
+                }
+                if (slot->rx_hold_since == 0) {
+                    slot->rx_hold_since = rte_rdtsc();
+                } else if (unlikely(rte_rdtsc() - slot->rx_hold_since >= rxq_hold_cycles)) {
+                    POLLER_LOG_RL(WARNING, POLLBODY, "Socket %u held back packets for too long, dropping them\n",
+                            idx);
+                    slot_info->stats.rx_hold_timeouts++;
+                    slot->rx_hold_expired = true;
+                    break;
+                }
+                // Keep the packets that didn't fit, and try again at the next round
+                memmove(slot->rx_buffer, &slot->rx_buffer[n_enq], n_left * sizeof(slot->rx_buffer[0]));
+                slot->rx_count = n_left;
+                slot_info->stats.rx_delivered += n_enq;
+                if (udpdk_trace_enabled()) {
+                    trace_rx_account(slot_info, rx_lat, n_enq);
+                }
+                return n_left;
+            default:
+                break;
+        }
+        // Drop the packets that still don't fit
+        for (j = n_enq; j < slot->rx_count; j++)
+            rte_pktmbuf_free(slot->rx_buffer[j]);
+        slot_info->stats.rx_dropped_full += n_left;
+    } else {
+        // The ring had room for all the packets: the consumer caught up
+        slot->rx_hold_since = 0;
+        slot->rx_hold_expired = false;
+    }
+    slot_info->stats.rx_delivered += n_enq;
+    if (udpdk_trace_enabled()) {
+        trace_rx_account(slot_info, rx_lat, n_enq);
+    }
+    slot->rx_count = 0;
+    return 0;
 }
 
-static inline void enqueue_rx_packet(uint8_t exc_buf_idx, struct rte_mbuf *buf)
+/* Flush the packets staged for a socket, or drop them if it was closed meanwhile;
+ * return whether some packets are held back */
+static inline bool flush_rx_staged(unsigned i)
 {
+    struct exch_slot *slot = &exch_slots[i];
+    uint16_t j;
+
+    if (likely(exch_zone_desc->slots[i].bound)) {
+        if (flush_rx_queue(i) > 0) {
+            return true;
+        }
+    } else {
+        for (j = 0; j < slot->rx_count; j++) {
+            rte_pktmbuf_free(slot->rx_buffer[j]);
+        }
+        poller_stats->rx_drops[UDPDK_DROP_NO_BINDING] += slot->rx_count;
+        slot->rx_count = 0;
+        slot->rx_hold_since = 0;
+        slot->rx_hold_expired = false;
+    }
+    rx_staged[i / 64] &= ~(1ULL << (i % 64));
+    return false;
+}
+
+/* Flush the received packets to the rings of the sockets that have some, starting from the high-priority
+ * ones; return how many sockets hold back packets */
+static inline unsigned flush_rx_queues(void)
+{
+    unsigned i, w;
+    unsigned n_backlog = 0;
+    uint64_t prio[RTE_DIM(exch_zone_desc->prio_socks)];
+    uint64_t bits;
+
+    // Take a snapshot of the high-priority sockets, which the app may change meanwhile
+    for (w = 0; w < RTE_DIM(prio); w++) {
+        prio[w] = __atomic_load_n(&exch_zone_desc->prio_socks[w], __ATOMIC_ACQUIRE);
+        for (bits = prio[w] & rx_staged[w]; bits != 0; bits &= bits - 1) {
+            i = w * 64 + rte_bsf64(bits);
+            n_backlog += flush_rx_staged(i);
+        }
+    }
+    for (w = 0; w < RTE_DIM(prio); w++) {
+        for (bits = rx_staged[w] & ~prio[w]; bits != 0; bits &= bits - 1) {
+            i = w * 64 + rte_bsf64(bits);
+            n_backlog += flush_rx_staged(i);
+        }
+    }
+    return n_backlog;
+}
+
+static inline void enqueue_rx_packet(uint16_t exc_buf_idx, struct rte_mbuf *buf)
+{
+    struct exch_slot *slot = &exch_slots[exc_buf_idx];
+
+    // The buffer can be full only if it holds back packets due to backpressure
+    if (unlikely(slot->rx_count == EXCH_BUF_SIZE)) {
+        rte_pktmbuf_free(buf);
+        exch_zone_desc->slots[exc_buf_idx].stats.rx_dropped_full++;
+        return;
+    }
+    // The segment size of UDP_GRO is annotated on coalescing (the field may hold garbage from the NIC)
+    if (exch_zone_desc->slots[exc_buf_idx].gro) {
+        buf->tso_segsz = 0;
+    }
     // Enqueue the packet for the appropriate exc buffer, and increment the counter
-    exch_slots[exc_buf_idx].rx_buffer[exch_slots[exc_buf_idx].rx_count++] = buf;
+    slot->rx_buffer[slot->rx_count++] = buf;
+    rx_staged[exc_buf_idx / 64] |= 1ULL << (exc_buf_idx % 64);
 }
 
 static inline uint16_t is_udp_pkt(struct rte_ipv4_hdr *ip_hdr)
@@ -307,94 +727,300 @@ static inline uint16_t get_udp_dst_port(struct rte_udp_hdr *udp_hdr)
     return udp_hdr->dst_port;
 }
 
-static inline unsigned long get_ipv4_dst_addr(struct rte_ipv4_hdr *ip_hdr)
+static inline uint32_t get_ipv4_dst_addr(struct rte_ipv4_hdr *ip_hdr)
 {
     return ip_hdr->dst_addr;
 }
 
-// TODO reassemble() is given too much responsibility: decompose into multiple functions
-static inline void reassemble(struct rte_mbuf *m, uint16_t portid, uint32_t queue,
-                              struct lcore_queue_conf *qconf, uint64_t tms)
+/* Read the destination of a datagram (network byte order) */
+static inline void rx_get_dst(struct rte_mbuf *m, uint32_t *dst_addr, uint16_t *dst_port)
 {
-    struct rte_ether_hdr *eth_hdr;
     struct rte_ipv4_hdr *ip_hdr;
-    struct rte_ip_frag_tbl *tbl;
-    struct rte_ip_frag_death_row *dr;
-    struct rx_queue *rxq;
-    uint16_t udp_dst_port;
-    unsigned long ip_dst_addr;
-    int sock_id;
-    bool delivered_once = false;
-    bool delivered_last = false;
 
-    rxq = &qconf->rx_queue;
+    ip_hdr = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+    *dst_addr = get_ipv4_dst_addr(ip_hdr);
+    *dst_port = get_udp_dst_port((struct rte_udp_hdr *)(ip_hdr + 1));
+}
 
-    eth_hdr = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+/* Check the IPv4 header checksum, trusting the NIC if it verified it */
+static inline bool rx_ipv4_cksum_ok(struct rte_mbuf *m, struct rte_ipv4_hdr *ip_hdr)
+{
+    switch (m->ol_flags & PKT_RX_IP_CKSUM_MASK) {
+        case PKT_RX_IP_CKSUM_GOOD:
+        case PKT_RX_IP_CKSUM_NONE:      // header integrity verified, checksum field not valid
+            return true;
+        case PKT_RX_IP_CKSUM_BAD:
+            return false;
+        default:                        // unknown: verify in software
+            return udpdk_ipv4_cksum_ok(ip_hdr);
+    }
+}
 
-    if (RTE_ETH_IS_IPV4_HDR(m->packet_type)) {
+/* Check the UDP checksum, trusting the NIC if it verified it (not for reassembled datagrams) */
+static inline bool rx_udp_cksum_ok(struct rte_mbuf *m, struct rte_ipv4_hdr *ip_hdr,
+                                   struct rte_udp_hdr *udp_hdr, bool reassembled)
+{
+    if (!reassembled) {
+        switch (m->ol_flags & PKT_RX_L4_CKSUM_MASK) {
+            case PKT_RX_L4_CKSUM_GOOD:
+            case PKT_RX_L4_CKSUM_NONE:  // data integrity verified, checksum field not valid
+                return true;
+            case PKT_RX_L4_CKSUM_BAD:
+                return false;
+            default:
+                break;
+        }
+    }
+    return udpdk_udp_cksum_ok(m, ip_hdr, udp_hdr, (uint8_t *)udp_hdr - rte_pktmbuf_mtod(m, uint8_t *));
+}
 
-        ip_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+/* Admit a fragment unless its source already sent frag_max_per_src of them in the current window.
+ * Sources are hashed into FRAG_SRC_SLOTS_LOG2 bits: colliding sources share the same budget */
+static inline bool frag_src_admit(uint32_t src_addr, uint64_t tms)
+{
+    struct frag_src_slot *s;
 
-        if (rte_ipv4_frag_pkt_is_fragmented(ip_hdr)) {
-            struct rte_mbuf *mo;
+    s = &frag_srcs[(src_addr * 2654435761u) >> (32 - FRAG_SRC_SLOTS_LOG2)];
+    if (tms - s->window_start > frag_src_window) {
+        s->window_start = tms;
+        s->count = 0;
+    }
+    return ++s->count <= (uint32_t)config.frag_max_per_src;
+}
 
-            tbl = rxq->frag_tbl;
-            dr = &qconf->death_row;
+/* Account the outcome of a fragment, from the mbufs that the reassembly put in the death row */
+static inline void reasm_account(const struct rte_ip_frag_death_row *dr, uint32_t dr_cnt,
+                                 struct rte_mbuf *m, struct rte_mbuf *mo)
+{
+    uint32_t n_freed = dr->cnt - dr_cnt;
 
-            // prepare mbuf (setup l2_len/l3_len)
-            m->l2_len = sizeof(*eth_hdr);
-            m->l3_len = sizeof(*ip_hdr);
+    if (mo != NULL) {
+        poller_stats->reasm.reassembled++;
+    }
+    if (n_freed == 0) {
+        return;
+    }
+    // The fragment itself is freed last when it could not be stored (table full or invalid datagram)
+    if (dr->row[dr->cnt - 1] == m) {
+        poller_stats->reasm.frags_table_full++;
+        n_freed--;
+    }
+    // The others belong to datagrams that were still incomplete
+    poller_stats->reasm.frags_timed_out += n_freed;
+}
+
+/* Drop a packet that is not UDP or whose checksum is wrong; return whether it is a valid datagram */
+static inline bool rx_udp_valid(struct rte_mbuf *m, struct rte_ipv4_hdr *ip_hdr, bool reassembled)
+{
+    if (!is_udp_pkt(ip_hdr)) {
+        poller_stats->rx_drops[UDPDK_DROP_NOT_UDP]++;
+        POLLER_LOG_RL(DEBUG, POLLBODY, "Dropped non-UDP packet (protocol %u)\n", ip_hdr->next_proto_id);
+        rte_pktmbuf_free(m);
+        return false;
+    }
+    if (unlikely(!rx_udp_cksum_ok(m, ip_hdr, (struct rte_udp_hdr *)(ip_hdr + 1), reassembled))) {
+        poller_stats->rx_drops[UDPDK_DROP_BAD_UDP_CKSUM]++;
+        POLLER_LOG_RL(DEBUG, POLLBODY, "Dropped datagram with bad UDP checksum\n");
+        rte_pktmbuf_free(m);
+        return false;
+    }
+    return true;
+}
 
-            // Handle this fragment (returns # of fragments if all already received, NULL otherwise)
-            mo = rte_ipv4_frag_reassemble_packet(tbl, dr, m, tms, ip_hdr);
-            if (mo == NULL)
-                // More fragments needed...
-                return;
+/* Outcome of the classification of a received packet */
+enum rx_class {
+    RX_CLASS_DGRAM,     // complete UDP datagram, ready for demux
+    RX_CLASS_FRAG,      // IPv4 fragment, to be reassembled
+    RX_CLASS_DROP       // dropped (and freed)
+};
 
-            // Reassembled packet (update pointers to headers if needed)
-            if (mo != m) {
-                m = mo;
-                eth_hdr = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
-                ip_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
-                // TODO must fix the IP header checksum as done in ip-sec example
+/* Classify a packet that is not a plain IPv4/UDP datagram according to the parser */
+static enum rx_class rx_classify_slow(struct rte_mbuf *m)
+{
+    struct rte_ether_hdr *eth_hdr;
+    struct rte_ipv4_hdr *ip_hdr;
+
+    eth_hdr = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    if (!RTE_ETH_IS_IPV4_HDR(m->packet_type)) {
+        poller_stats->rx_drops[UDPDK_DROP_NOT_IPV4]++;
+        POLLER_LOG_RL(DEBUG, POLLBODY, "Dropped non-IPv4 packet (ether_type 0x%04x)\n",
+                rte_be_to_cpu_16(eth_hdr->ether_type));
+        rte_pktmbuf_free(m);
+        return RX_CLASS_DROP;
+    }
+    ip_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+
+    // Drop the packets with a corrupted header (before they reach the reassembly table)
+    if (unlikely(!rx_ipv4_cksum_ok(m, ip_hdr))) {
+        poller_stats->rx_drops[UDPDK_DROP_BAD_IP_CKSUM]++;
+        POLLER_LOG_RL(DEBUG, POLLBODY, "Dropped packet with bad IPv4 checksum\n");
+        rte_pktmbuf_free(m);
+        return RX_CLASS_DROP;
+    }
+    if (rte_ipv4_frag_pkt_is_fragmented(ip_hdr)) {
+        return RX_CLASS_FRAG;
+    }
+    return rx_udp_valid(m, ip_hdr, false) ? RX_CLASS_DGRAM : RX_CLASS_DROP;
+}
+
+/* Classify a burst of received packets, dropping the invalid ones. The others are compacted at the
+ * head of pkts, in order, with their destinations in dst_addr and dst_port (not for fragments), and
+ * the positions of the fragments among them are stored in frag_idx. Return the number of packets kept */
+static __rte_always_inline uint16_t rx_classify(struct rte_mbuf **pkts, uint16_t n, uint32_t *dst_addr,
+        uint16_t *dst_port, uint16_t *frag_idx, uint16_t *n_frags, const bool rx_reasm)
+{
+    struct rte_mbuf *m;
+    struct rte_ipv4_hdr *ip_hdr;
+    uint8_t fast[RX_MBUF_TABLE_SIZE];
+    uint64_t rx_bytes = 0;
+    uint16_t i, n_keep = 0;
+
+    // Find the unfragmented IPv4/UDP datagrams, and their destinations, for the whole burst
+    rx_parse(pkts, n, fast, dst_addr, dst_port, config.rx_prefetch);
+
+    *n_frags = 0;
+    for (i = 0; i < n; i++) {
+        m = pkts[i];
+        rx_bytes += m->pkt_len;
+
+        // Fast path: only the checksums are left to check
+        if (likely(fast[i])) {
+            ip_hdr = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+            if (likely(rx_ipv4_cksum_ok(m, ip_hdr))) {
+                if (likely(rx_udp_valid(m, ip_hdr, false))) {
+                    dst_addr[n_keep] = dst_addr[i];
+                    dst_port[n_keep] = dst_port[i];
+                    pkts[n_keep++] = m;
+                }
+                continue;
             }
         }
-    } else {
-        RTE_LOG(WARNING, POLLBODY, "Received non-IPv4 packet, showing content below:\n");
-        udpdk_dump_mbuf(m);
-        return;
+        switch (rx_classify_slow(m)) {
+            case RX_CLASS_FRAG:
+                if (!rx_reasm) {
+                    poller_stats->rx_drops[UDPDK_DROP_FRAG_DISABLED]++;
+                    POLLER_LOG_RL(DEBUG, POLLBODY, "Dropped fragment (reassembly disabled)\n");
+                    rte_pktmbuf_free(m);
+                    break;
+                }
+                frag_idx[(*n_frags)++] = n_keep;
+                pkts[n_keep++] = m;
+                break;
+            case RX_CLASS_DGRAM:
+                rx_get_dst(m, &dst_addr[n_keep], &dst_port[n_keep]);
+                pkts[n_keep++] = m;
+                break;
+            default:
+                break;
+        }
     }
+    poller_stats->rxq[QUEUE_RX].bytes += rx_bytes;
+    return n_keep;
+}
 
-    if (!is_udp_pkt(ip_hdr)) {
-        RTE_LOG(WARNING, POLLBODY, "Received non-UDP packet.\n");
-        return;
+/* Insert a fragment in the reassembly table; return the datagram if it is complete and valid, NULL otherwise */
+static inline struct rte_mbuf *reassemble(struct rte_mbuf *m, struct lcore_queue_conf *qconf, uint64_t tms)
+{
+    struct rte_ether_hdr *eth_hdr;
+    struct rte_ipv4_hdr *ip_hdr;
+    struct rte_ip_frag_death_row *dr;
+    struct rte_mbuf *mo;
+    uint32_t dr_cnt;
+
+    eth_hdr = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    ip_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+    dr = &qconf->death_row;
+
+    // Do not let a single source fill the table (and drain the pool) with fragments
+    if (config.frag_max_per_src > 0 && !frag_src_admit(ip_hdr->src_addr, tms)) {
+        poller_stats->rx_drops[UDPDK_DROP_FRAG_SRC_CAP]++;
+        POLLER_LOG_RL(DEBUG, POLLBODY, "Dropped fragment from a source over the cap\n");
+        rte_pktmbuf_free(m);
+        return NULL;
     }
-    udp_dst_port = get_udp_dst_port((struct rte_udp_hdr *)(ip_hdr + 1));
-    ip_dst_addr = get_ipv4_dst_addr(ip_hdr);
 
-    // Find the sock_ids corresponding to the UDP dst port (L4 switching) and enqueue the packet to its queue
-    udpdk_list_t *binds = btable_get_bindings(udp_dst_port);
+    // A call may add up to two datagrams of fragments to the death row: free it before it overflows
+    if (unlikely(dr->cnt + DEATH_ROW_SLACK > RTE_DIM(dr->row))) {
+        rte_ip_frag_free_death_row(dr, PREFETCH_OFFSET);
+    }
+
+    // prepare mbuf (setup l2_len/l3_len)
+    m->l2_len = sizeof(*eth_hdr);
+    m->l3_len = sizeof(*ip_hdr);
+
+    // Handle this fragment (returns # of fragments if all already received, NULL otherwise)
+    dr_cnt = dr->cnt;
+    mo = rte_ipv4_frag_reassemble_packet(qconf->rx_queue.frag_tbl, dr, m, tms, ip_hdr);
+    reasm_account(dr, dr_cnt, m, mo);
+    if (mo == NULL)
+        // More fragments needed...
+        return NULL;
+
+    // Reassembled packet (update pointers to headers if needed)
+    if (mo != m) {
+        eth_hdr = rte_pktmbuf_mtod(mo, struct rte_ether_hdr *);
+        ip_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+    }
+    // The reassembly rewrote length and offset, so fix the header checksum
+    ip_hdr->hdr_checksum = 0;
+    ip_hdr->hdr_checksum = udpdk_ipv4_cksum(ip_hdr);
+    return rx_udp_valid(mo, ip_hdr, true) ? mo : NULL;
+}
+
+/* Deliver a datagram to the sockets bound to its destination port (binds), matching the address.
+ * Without shared_ports, a port has at most one binding and the datagram is never cloned */
+static __rte_always_inline void rx_deliver(struct rte_mbuf *m, uint32_t ip_dst_addr, uint16_t udp_dst_port,
+        udpdk_list_t *binds, struct rte_mempool *pool, const bool shared_ports)
+{
+    struct bind_info *b;
+    udpdk_list_node_t *node;
+    bool delivered_once = false;
+    bool delivered_last = false;
+
     if (binds == NULL) {
-        RTE_LOG(WARNING, POLLBODY, "Dropping packet for port %d: no socket bound\n", ntohs(udp_dst_port));
+        poller_stats->rx_drops[UDPDK_DROP_NO_BINDING]++;
+        POLLER_LOG_RL(WARNING, POLLBODY, "Dropped packet to port %d: no socket bound\n", ntohs(udp_dst_port));
+        rte_pktmbuf_free(m);
         return;
     }
-    udpdk_list_iterator_t *it = list_iterator_new(binds, LIST_HEAD);
-    udpdk_list_node_t *node;
-    while ((node = list_iterator_next(it))) {
-        unsigned long ip_oth = ((struct bind_info *)(node->val))->ip_addr.s_addr;
-        bool oth_reuseaddr = ((struct bind_info *)(node->val))->reuse_addr;
-        bool oth_reuseport = ((struct bind_info *)(node->val))->reuse_port;
+    if (!shared_ports) {
+        b = (struct bind_info *)binds->head->val;
+        if (likely((ip_dst_addr == b->ip_addr.s_addr) || (b->ip_addr.s_addr == INADDR_ANY))) {
+            enqueue_rx_packet(b->sockfd, m);
+            return;
+        }
+        rte_pktmbuf_free(m);
+        poller_stats->rx_drops[UDPDK_DROP_NO_MATCH]++;
+        POLLER_LOG_RL(WARNING, POLLBODY, "Dropped packet to port %d: no socket matching\n", ntohs(udp_dst_port));
+        return;
+    }
+    // Walk the list directly (an iterator would be allocated in shared memory for every packet)
+    for (node = binds->head; node != NULL; node = node->next) {
+        b = (struct bind_info *)node->val;
         // TODO the semantic should be more complex actually:
         //   if dest unicast and SO_REUSEPORT, should load balance
         //   if dest broadcast and SO_REUSEADDR or SO_REUSEPORT, should deliver to all
         // If matching
-        if (likely((ip_dst_addr == ip_oth) || (ip_oth == INADDR_ANY))) {
+        if (likely((ip_dst_addr == b->ip_addr.s_addr) || (b->ip_addr.s_addr == INADDR_ANY))) {
             // Deliver to this socket
-            enqueue_rx_packet(((struct bind_info *)(node->val))->sockfd, m);
+            enqueue_rx_packet(b->sockfd, m);
             delivered_once = true;
             // If other socket may exist on the same port, keep scanning
-            if (oth_reuseaddr || oth_reuseport) {
-                m = rte_pktmbuf_clone(m, rxq->pool);
+            if (b->reuse_addr || b->reuse_port) {
+                struct rte_mbuf *mc = rte_pktmbuf_clone(m, pool);
+                if (unlikely(mc == NULL)) {
+                    poller_stats->rx_drops[UDPDK_DROP_NO_MBUF]++;
+                    delivered_last = true;  // nothing left to free
+                    break;
+                }
+                // The clone does not inherit the dynamic fields
+                if (udpdk_tstamp_enabled()) {
+                    *udpdk_mbuf_rx_tsc(mc) = *udpdk_mbuf_rx_tsc(m);
+                }
+                if (udpdk_trace_enabled()) {
+                    *udpdk_mbuf_trace(mc) = *udpdk_mbuf_trace(m);
+                }
+                m = mc;
                 delivered_last = false;
                 continue;
             } else {
@@ -407,25 +1033,434 @@ static inline void reassemble(struct rte_mbuf *m, uint16_t portid, uint32_t queu
         rte_pktmbuf_free(m);
     }
     if (!delivered_once) {
-        RTE_LOG(WARNING, POLLBODY, "Dropped packet to port %d: no socket matching\n", ntohs(udp_dst_port));
+        poller_stats->rx_drops[UDPDK_DROP_NO_MATCH]++;
+        POLLER_LOG_RL(WARNING, POLLBODY, "Dropped packet to port %d: no socket matching\n", ntohs(udp_dst_port));
+    }
+}
+
+/* Prefetch the demux target of the datagrams to a port: the RX staging buffer of the socket of its first
+ * binding, and the descriptor of its slot. The entry of the bind table was prefetched one stage earlier */
+static inline void rx_prefetch_target(uint16_t port)
+{
+    udpdk_list_t *binds;
+    int sockfd;
+
+    binds = btable_get_bindings(port);
+    if (binds == NULL || binds->head == NULL) {
+        return;
+    }
+    sockfd = ((struct bind_info *)binds->head->val)->sockfd;
+    rte_prefetch0(&exch_slots[sockfd].rx_count);
+    rte_prefetch0(&exch_zone_desc->slots[sockfd]);
+}
+
+/* Process a burst of received packets: classify them, reassemble the fragments, then demux the datagrams.
+ * Each stage runs over the whole burst, so the common case (unfragmented datagrams) is a tight loop */
+static __rte_always_inline void rx_process_burst(struct rte_mbuf **pkts, uint16_t n,
+        struct lcore_queue_conf *qconf, uint64_t tms, const bool rx_reasm, const bool shared_ports)
+{
+    uint32_t dst_addr[RX_MBUF_TABLE_SIZE];
+    uint16_t dst_port[RX_MBUF_TABLE_SIZE];
+    uint16_t frag_idx[RX_MBUF_TABLE_SIZE];
+    uint16_t n_frags;
+    uint16_t i, pf;
+    udpdk_list_t *binds = NULL;
+    int last_port = -1;
+
+    n = rx_classify(pkts, n, dst_addr, dst_port, frag_idx, &n_frags, rx_reasm);
+
+    // Replace each fragment with the datagram it completes (or NULL), preserving the order of arrival.
+    // A NULL entry takes the port of the previous one, so that the prefetching below skips it
+    for (i = 0; i < n_frags; i++) {
+        pkts[frag_idx[i]] = reassemble(pkts[frag_idx[i]], qconf, tms);
+        if (pkts[frag_idx[i]] != NULL) {
+            rx_get_dst(pkts[frag_idx[i]], &dst_addr[frag_idx[i]], &dst_port[frag_idx[i]]);
+        } else {
+            dst_port[frag_idx[i]] = (frag_idx[i] > 0) ? dst_port[frag_idx[i] - 1] : 0;
+        }
+    }
+
+    // Look up the bindings once per run of datagrams to the same port, prefetching the entry of the bind
+    // table 2*pf datagrams ahead, then the demux target pf datagrams ahead (skipping repeated ports)
+    pf = config.rx_prefetch;
+    for (i = 0; i < n; i++) {
+        if (pf > 0) {
+            if (i + 2 * pf < n && dst_port[i + 2 * pf] != dst_port[i + 2 * pf - 1]) {
+                rte_prefetch0(&sock_bind_table[dst_port[i + 2 * pf]]);
+            }
+            if (i + pf < n && dst_port[i + pf] != dst_port[i + pf - 1]) {
+                rx_prefetch_target(dst_port[i + pf]);
+            }
+        }
+        if (unlikely(pkts[i] == NULL)) {
+            continue;
+        }
+        if (dst_port[i] != last_port) {
+            binds = btable_get_bindings(dst_port[i]);
+            last_port = dst_port[i];
+        }
+        rx_deliver(pkts[i], dst_addr[i], dst_port[i], binds, qconf->rx_queue.pool, shared_ports);
     }
-    list_iterator_destroy(it);
 }
 
-static inline void flush_tx_table(struct rte_mbuf **tx_mbuf_table, uint16_t tx_count)
+static inline void flush_tx_table(struct rte_mbuf **tx_mbuf_table, uint16_t tx_count, uint16_t queue)
 {
     int tx_sent;
-    tx_sent = rte_eth_tx_burst(PORT_TX, QUEUE_TX, tx_mbuf_table, tx_count);
+    uint64_t tx_bytes = 0;
+    struct udpdk_txq_stats *txq_stats = &poller_stats->txq[queue];
+    uint16_t n_ok;
+
+    // Let the driver fix up the offload metadata, dropping the packets it rejects
+    if (exch_zone_desc->tx_offloads != 0) {
+        n_ok = 0;
+        while (n_ok < tx_count) {
+            n_ok += rte_eth_tx_prepare(PORT_TX, queue, &tx_mbuf_table[n_ok], tx_count - n_ok);
+            if (unlikely(n_ok < tx_count)) {
+                POLLER_LOG_RL(ERR, POLLBODY, "Packet rejected by tx_prepare: %s\n", rte_strerror(rte_errno));
+                rte_pktmbuf_free(tx_mbuf_table[n_ok]);
+                memmove(&tx_mbuf_table[n_ok], &tx_mbuf_table[n_ok + 1],
+                        (tx_count - n_ok - 1) * sizeof(tx_mbuf_table[0]));
+                tx_count--;
+                txq_stats->dropped++;
+            }
+        }
+    }
+
+    // Count the bytes before sending (the NIC may free the mbufs as soon as they are sent)
+    for (tx_sent = 0; tx_sent < tx_count; tx_sent++) {
+        tx_bytes += tx_mbuf_table[tx_sent]->pkt_len;
+    }
+    if (udpdk_trace_enabled()) {
+        trace_tx_burst(tx_mbuf_table, tx_count);
+    }
+    PROF_MARK(UDPDK_STAGE_TX_DEQUEUE);
+    tx_sent = rte_eth_tx_burst(PORT_TX, queue, tx_mbuf_table, tx_count);
+    txq_stats->pkts += tx_sent;
+    txq_stats->bursts++;
     if (unlikely(tx_sent < tx_count)) {
+        txq_stats->dropped += tx_count - tx_sent;
         // Free unsent mbufs
         do {
+            tx_bytes -= tx_mbuf_table[tx_sent]->pkt_len;
             rte_pktmbuf_free(tx_mbuf_table[tx_sent]);
         } while (++tx_sent < tx_count);
     }
+    txq_stats->bytes += tx_bytes;
+    PROF_MARK(UDPDK_STAGE_TX_BURST);
 }
 
-/* Packet polling routine */
-void poller_body(void)
+/* Put a packet dequeued from a socket in the TX table at position tx_count, split into datagrams (UDP_SEGMENT)
+ * or fragments if needed; return the number of mbufs added, or -1 if the fragmentation failed */
+static __rte_always_inline int tx_prepare_pkt(struct rte_mbuf *pkt, int sockfd, struct rte_mbuf **tx_mbuf_table,
+        uint16_t tx_count, struct lcore_queue_conf *qconf, const bool tx_frag)
+{
+    int n_fragments;
+    int n_segments;
+    int j;
+    struct udpdk_mbuf_trace trace_orig;
+
+    // Split the UDP_SEGMENT sends into datagrams, unless the NIC does it
+    if (unlikely(pkt->ol_flags & PKT_TX_UDP_SEG)
+            && !(exch_zone_desc->tx_offloads & DEV_TX_OFFLOAD_UDP_TSO)) {
+        PROF_MARK(UDPDK_STAGE_TX_DEQUEUE);
+        if (udpdk_trace_enabled()) {
+            trace_orig = *udpdk_mbuf_trace(pkt);
+        }
+        // There is always room for GSO_MAX_SEGS, as the table is flushed every BURST_SIZE
+        n_segments = udpdk_gso_segment(pkt, &tx_mbuf_table[tx_count],
+                (uint16_t)(TX_MBUF_TABLE_SIZE - tx_count),
+                qconf->tx_queue.direct_pool, qconf->tx_queue.indirect_pool,
+                exch_zone_desc->tx_offloads, exch_zone_desc->slots[sockfd].no_check);
+        // Free the original mbuf (the payload stays referenced by the datagrams)
+        rte_pktmbuf_free(pkt);
+        if (unlikely(n_segments < 0)) {
+            poller_stats->txq[QUEUE_TX].dropped++;
+            POLLER_LOG_RL(ERR, POLLBODY, "Failed to segment a packet\n");
+            PROF_MARK(UDPDK_STAGE_TX_FRAG);
+            return 0;
+        }
+        exch_zone_desc->slots[sockfd].stats.tx_gso_segments += n_segments;
+        if (udpdk_trace_enabled()) {
+            *udpdk_mbuf_trace(tx_mbuf_table[tx_count]) = trace_orig;
+            trace_orig.sockfd = -1;
+            for (j = tx_count + 1; j < tx_count + n_segments; j++) {
+                *udpdk_mbuf_trace(tx_mbuf_table[j]) = trace_orig;
+            }
+        }
+        PROF_MARK(UDPDK_STAGE_TX_FRAG);
+        return n_segments;
+    } else if (!tx_frag || likely(pkt->pkt_len <= config.mtu + RTE_ETHER_HDR_LEN)
+            || (pkt->ol_flags & PKT_TX_UDP_SEG)) {   // fragmentation not needed
+        tx_mbuf_table[tx_count] = pkt;
+        return 1;
+    } else {    // fragmentation needed (not done by the sending thread)
+        PROF_MARK(UDPDK_STAGE_TX_DEQUEUE);
+        if (udpdk_trace_enabled()) {
+            trace_orig = *udpdk_mbuf_trace(pkt);
+        }
+        // Put the fragments in the TX table, one after the other starting from the pos of the last mbuf
+        n_fragments = udpdk_ipv4_fragment(pkt, &tx_mbuf_table[tx_count],
+                (uint16_t)(TX_MBUF_TABLE_SIZE - tx_count),
+                qconf->tx_queue.direct_pool, qconf->tx_queue.indirect_pool,
+                exch_zone_desc->tx_offloads);
+        // Free the original mbuf
+        rte_pktmbuf_free(pkt);
+        if (unlikely(n_fragments < 0)) {
+            poller_stats->txq[QUEUE_TX].dropped++;
+            POLLER_LOG_RL(ERR, POLLBODY, "Failed to fragment a packet\n");
+            PROF_MARK(UDPDK_STAGE_TX_FRAG);
+            return -1;
+        }
+        // Shared with the sending threads, which fragment the packets of the app themselves
+        __atomic_fetch_add(&exch_zone_desc->slots[sockfd].stats.tx_fragmented, 1, __ATOMIC_RELAXED);
+        // Account the datagram once, on its first fragment
+        if (udpdk_trace_enabled()) {
+            for (j = tx_count; j < tx_count + n_fragments; j++) {
+                *udpdk_mbuf_trace(tx_mbuf_table[j]) = trace_orig;
+                trace_orig.sockfd = -1;
+            }
+        }
+        PROF_MARK(UDPDK_STAGE_TX_FRAG);
+        return n_fragments;
+    }
+}
+
+/* Hold a packet of a socket in the timer wheel until its launch time (SO_TXTIME), or drop it if the wheel is
+ * full; return false if it is due already */
+static inline bool tx_schedule_pkt(struct rte_mbuf *pkt, int sockfd, uint64_t now)
+{
+    int ret = txtime_wheel_add(&txtime_wheel, pkt, sockfd);
+
+    if (ret > 0) {
+        poller_stats->txtime.scheduled++;
+        return true;
+    }
+    if (unlikely(ret < 0)) {
+        POLLER_LOG_RL(ERR, POLLBODY, "Dropped a scheduled packet (timer wheel full)\n");
+        poller_stats->txtime.dropped++;
+        rte_pktmbuf_free(pkt);
+        return true;
+    }
+    // Count the packets that missed their tick (the app sent them too late, or the poller was busy)
+    if (*udpdk_mbuf_txtime(pkt) + txtime_wheel.tick_cycles <= now) {
+        poller_stats->txtime.late++;
+    }
+    return false;
+}
+
+/* Send the packets whose launch time has come (SO_TXTIME) right away, on the TX queue of the high-priority
+ * sockets, so that they do not wait behind the others; return the number of packets released */
+static __rte_always_inline uint16_t tx_release_scheduled(struct lcore_queue_conf *qconf, uint64_t now,
+        const bool tx_frag)
+{
+    struct rte_mbuf **tx_mbuf_table = qconf->tx_queue.tx_prio_mbuf_table;
+    struct rte_mbuf *pkts[BURST_SIZE];
+    int sockfds[BURST_SIZE];
+    uint16_t tx_count = 0, n_rel = 0, n_due, j;
+    int n;
+
+    while ((n_due = txtime_wheel_advance(&txtime_wheel, now, pkts, sockfds, BURST_SIZE)) > 0) {
+        for (j = 0; j < n_due; j++) {
+            if (tx_count >= config.tx_burst) {
+                flush_tx_table(tx_mbuf_table, tx_count, exch_zone_desc->txq_prio);
+                tx_count = 0;
+            }
+            n = tx_prepare_pkt(pkts[j], sockfds[j], tx_mbuf_table, tx_count, qconf, tx_frag);
+            if (likely(n > 0)) {
+                tx_count += n;
+            }
+        }
+        n_rel += n_due;
+    }
+    if (tx_count > 0) {
+        flush_tx_table(tx_mbuf_table, tx_count, exch_zone_desc->txq_prio);
+    }
+    return n_rel;
+}
+
+/* Take the next packet to send for a socket: the one held back before (held is set), or the head of its TX ring */
+static __rte_always_inline struct rte_mbuf *tx_next_pkt(struct exch_slot *slot, int sockfd, uint64_t now, bool *held)
+{
+    struct rte_mbuf *pkt;
+
+    if (slot->tx_pending != NULL) {
+        pkt = slot->tx_pending;
+        slot->tx_pending = NULL;
+        tx_n_pending--;
+        *held = true;
+        return pkt;
+    }
+    if (rte_ring_dequeue(exch_zone_desc->slots[sockfd].tx_q, (void **)&pkt) < 0) {
+        return NULL;
+    }
+    if (udpdk_trace_enabled()) {
+        trace_tx_dequeue(pkt, sockfd, now);
+    }
+    *held = false;
+    return pkt;
+}
+
+/* Put a packet that passed the TX scheduler of its socket in the TX table, unless its launch time is in the
+ * future (SO_TXTIME): then it goes to the timer wheel, having already been charged to the DRR deficit and
+ * token buckets of the socket; return the number of entries added to the table (-1 on error) */
+static __rte_always_inline int tx_submit_pkt(struct rte_mbuf *pkt, int sockfd, struct rte_mbuf **tx_mbuf_table,
+        uint16_t tx_count, struct lcore_queue_conf *qconf, uint64_t now, const bool tx_frag)
+{
+    if (udpdk_txtime_enabled() && (pkt->ol_flags & udpdk_txtime_flag) && tx_schedule_pkt(pkt, sockfd, now)) {
+        return 0;
+    }
+    return tx_prepare_pkt(pkt, sockfd, tx_mbuf_table, tx_count, qconf, tx_frag);
+}
+
+/* Hold back a packet of a socket, to be sent first at the next round */
+static inline void tx_hold_pkt(struct exch_slot *slot, struct rte_mbuf *pkt)
+{
+    slot->tx_pending = pkt;
+    tx_n_pending++;
+}
+
+/* Hold back a packet that exceeds the rate limit of its socket (counted once, even if held again) */
+static inline void tx_throttle_pkt(struct exch_slot *slot, int sockfd, struct rte_mbuf *pkt, bool held)
+{
+    if (!held) {
+        exch_zone_desc->slots[sockfd].stats.tx_throttled++;
+    }
+    tx_hold_pkt(slot, pkt);
+}
+
+/* Reload the token buckets of a socket if the app changed its rate limit */
+static inline void tx_rate_reload(struct exch_slot *slot, struct exch_slot_info *slot_info)
+{
+    uint32_t gen = __atomic_load_n(&slot_info->tx_rate_gen, __ATOMIC_ACQUIRE);
+    struct udpdk_tx_rate rate;
+
+    if (likely(gen == slot->tx_rate_gen)) {
+        return;
+    }
+    slot->tx_rate_gen = gen;
+    rate = slot_info->tx_rate;
+    // A bucket with rate 0 is not enforced
+    slot->tx_tb_bytes.rate = 0;
+    slot->tx_tb_pkts.rate = 0;
+    if (rate.bytes_per_sec > 0) {
+        tb_init(&slot->tx_tb_bytes, rate.bytes_per_sec, rate.burst_bytes);
+    }
+    if (rate.pkts_per_sec > 0) {
+        tb_init(&slot->tx_tb_pkts, rate.pkts_per_sec, rate.burst_pkts);
+    }
+    slot->tx_limited = (rate.bytes_per_sec > 0 || rate.pkts_per_sec > 0);
+}
+
+/* Tell whether a packet of a rate-limited socket can be sent now and, if so, take its tokens
+ * (the datagrams and bytes that will be on the wire, once split by UDP_SEGMENT) */
+static inline bool tx_rate_conform(struct exch_slot *slot, struct rte_mbuf *pkt, uint64_t now)
+{
+    struct token_bucket *tb_bytes = &slot->tx_tb_bytes;
+    struct token_bucket *tb_pkts = &slot->tx_tb_pkts;
+    uint32_t hdr_len = 0, n_dgrams = 1;
+
+    if ((tb_bytes->rate > 0 && !tb_ready(tb_bytes, now)) || (tb_pkts->rate > 0 && !tb_ready(tb_pkts, now))) {
+        return false;
+    }
+    if ((pkt->ol_flags & PKT_TX_UDP_SEG) && pkt->tso_segsz > 0) {
+        hdr_len = pkt->l2_len + pkt->l3_len + pkt->l4_len;
+        n_dgrams = RTE_MAX((pkt->pkt_len - hdr_len + pkt->tso_segsz - 1) / pkt->tso_segsz, 1U);
+    }
+    if (tb_bytes->rate > 0) {
+        tb_borrow(tb_bytes, pkt->pkt_len + (n_dgrams - 1) * hdr_len);
+    }
+    if (tb_pkts->rate > 0) {
+        tb_borrow(tb_pkts, n_dgrams);
+    }
+    return true;
+}
+
+/* Drain the TX rings of the high-priority sockets (SO_PRIORITY) before the others, and send their packets
+ * right away on their own TX queue (if configured); return the number of packets dequeued */
+static __rte_always_inline uint16_t tx_drain_prio(struct lcore_queue_conf *qconf, uint64_t now, const bool tx_frag)
+{
+    struct rte_mbuf **tx_mbuf_table = qconf->tx_queue.tx_prio_mbuf_table;
+    struct rte_mbuf *pkt;
+    struct exch_slot *slot;
+    uint16_t tx_count = 0, n_deq = 0;
+    uint64_t bits;
+    unsigned w;
+    int i, n;
+    bool held;
+
+    for (w = 0; w < RTE_DIM(exch_zone_desc->prio_socks); w++) {
+        bits = __atomic_load_n(&exch_zone_desc->prio_socks[w], __ATOMIC_ACQUIRE);
+        for (; bits != 0; bits &= bits - 1) {
+            i = w * 64 + rte_bsf64(bits);
+            if (!exch_zone_desc->slots[i].bound) {
+                continue;
+            }
+            slot = &exch_slots[i];
+            tx_rate_reload(slot, &exch_zone_desc->slots[i]);
+            while (1) {
+                if (tx_count >= config.tx_burst) {
+                    flush_tx_table(tx_mbuf_table, tx_count, exch_zone_desc->txq_prio);
+                    tx_count = 0;
+                }
+                pkt = tx_next_pkt(slot, i, now, &held);
+                if (pkt == NULL) {
+                    break;
+                }
+                if (unlikely(slot->tx_limited) && !tx_rate_conform(slot, pkt, now)) {
+                    tx_throttle_pkt(slot, i, pkt, held);
+                    break;
+                }
+                n_deq++;
+                n = tx_submit_pkt(pkt, i, tx_mbuf_table, tx_count, qconf, now, tx_frag);
+                if (unlikely(n < 0)) {
+                    break;
+                }
+                tx_count += n;
+            }
+        }
+    }
+    if (tx_count > 0) {
+        flush_tx_table(tx_mbuf_table, tx_count, exch_zone_desc->txq_prio);
+    }
+    return n_deq;
+}
+
+/* Decide whether to send the packets left in the TX table at the end of a loop iteration,
+ * n_new being the packets dequeued from the sockets in this iteration */
+static inline bool tx_flush_due(struct tx_flush_state *st, uint16_t tx_count, uint16_t n_new, uint64_t now)
+{
+    if (config.tx_flush == UDPDK_TX_FLUSH_IMMEDIATE) {
+        return tx_count > 0;
+    }
+    // Estimate the TX rate over windows of tx_flush_us: coalescing only pays if bursts fill up meanwhile
+    if (config.tx_flush == UDPDK_TX_FLUSH_ADAPTIVE) {
+        st->window_pkts += n_new;
+        if (now >= st->window_end) {
+            st->under_load = st->window_pkts >= (uint64_t)config.tx_burst;
+            st->window_pkts = 0;
+            st->window_end = now + tx_flush_cycles;
+        }
+        if (!st->under_load) {
+            return tx_count > 0;
+        }
+    }
+    if (tx_count == 0) {
+        return false;
+    }
+    // Bound the wait of the oldest packet (the full bursts are sent as soon as they are ready)
+    if (st->deadline == 0) {
+        st->deadline = now + tx_flush_cycles;
+    }
+    if (now >= st->deadline) {
+        poller_stats->txq[QUEUE_TX].flush_timeout++;
+        return true;
+    }
+    return false;
+}
+
+/* Packet polling loop, specialized on the features enabled in the configuration: with constant
+ * arguments, the code of the disabled ones is compiled out of each variant */
+static __rte_always_inline void poller_loop(const bool tx_frag, const bool rx_reasm, const bool shared_ports)
 {
     unsigned lcore_id;
     uint64_t cur_tsc;
@@ -433,12 +1468,19 @@ void poller_body(void)
     struct rte_mbuf **rx_mbuf_table;
     struct rte_mbuf **tx_mbuf_table;
     struct rte_mbuf *pkt = NULL;
-    const struct rte_ether_hdr *old_eth_hdr;
-    struct rte_ether_hdr *new_eth_hdr;
     uint16_t rx_count = 0, tx_count = 0;
-    uint64_t ol_flags;
-    int n_fragments;
-    int i, j;
+    unsigned rx_backlog = 0;
+    int i, n;
+    bool busy;
+    struct tx_flush_state tx_flush = {0};
+    uint16_t tx_dequeued;
+    struct exch_slot *slot;
+    unsigned tx_rr = 0, k;
+    uint32_t tx_quantum;
+    bool held;
+
+    // Bytes that a socket of weight 1 can send per round of the TX scheduler
+    tx_quantum = config.mtu + RTE_ETHER_HDR_LEN;
 
     lcore_id = rte_lcore_id();
     qconf = &lcore_queue_conf[lcore_id];
@@ -446,104 +1488,161 @@ void poller_body(void)
     tx_mbuf_table = qconf->tx_queue.tx_mbuf_table;
 
     while (poller_alive) {
+        // Start a new iteration: the sockets unbound before it are not touched anymore (see udpdk_close).
+        // This is also a full barrier, so the state of the sockets is read after the increment
+        __atomic_fetch_add(&exch_zone_desc->poller_epoch, 1, __ATOMIC_SEQ_CST);
+
         // Get current timestamp (needed for reassembly)
         cur_tsc = rte_rdtsc();
+        PROF_START(cur_tsc);
+        busy = false;
+        tx_dequeued = 0;
 
-        // Transmit packets to DPDK port 0 (queue 0)
-        for (i = 0; i < NUM_SOCKETS_MAX; i++) {
-            if (exch_zone_desc->slots[i].used) {
-                while (tx_count < BURST_SIZE) {
-                    // Try to dequeue one packet (and move to next slot if this was empty)
-                    if (rte_ring_dequeue(exch_slots[i].tx_q, (void **)&pkt) < 0) {
-                        break;
-                    }
-                    // Fragment the packet if needed
-                    if (likely(pkt->pkt_len <= IPV4_MTU_DEFAULT)) {   // fragmentation not needed
-                        tx_mbuf_table[tx_count] = pkt;
-                        tx_count++;
-                    } else {    // fragmentation needed
-                        // Save the Ethernet header and strip it (because fragmentation applies from IPv4 header)
-                        old_eth_hdr = rte_pktmbuf_mtod(pkt, const struct rte_ether_hdr *);
-                        rte_pktmbuf_adj(pkt, (uint16_t)sizeof(struct rte_ether_hdr));
-                        // Put the fragments in the TX table, one after the other starting from the pos of the last mbuf
-                        n_fragments = rte_ipv4_fragment_packet(pkt, &tx_mbuf_table[tx_count],
-                                (uint16_t)(TX_MBUF_TABLE_SIZE - tx_count), IPV4_MTU_DEFAULT,
-                                qconf->tx_queue.direct_pool, qconf->tx_queue.indirect_pool);
-                        // Free the original mbuf
-                        rte_pktmbuf_free(pkt);
-                        // Checksum must be recomputed
-                        ol_flags = (PKT_TX_IPV4 | PKT_TX_IP_CKSUM);
-                        if (unlikely(n_fragments < 0)) {
-                            RTE_LOG(ERR, POLLBODY, "Failed to fragment a packet\n");
-                            break;
-                        }
-                        // Re-attach (and adjust) the Ethernet header to each fragment
-                        for (j = tx_count; j < tx_count + n_fragments; j++) {
-                            pkt = tx_mbuf_table[j];
-                            new_eth_hdr = (struct rte_ether_hdr *)rte_pktmbuf_prepend(pkt, sizeof(struct rte_ether_hdr));
-                            if (unlikely(new_eth_hdr == NULL)) {
-                                RTE_LOG(ERR, POLLBODY, "mbuf has no room to rebuild the Ethernet header\n");
-                                for (int k = tx_count; k < tx_count + n_fragments; k++) {
-                                    rte_pktmbuf_free(tx_mbuf_table[k]);
-                                }
-                                tx_count -= n_fragments;
-                                break;
-                            }
-                            new_eth_hdr->ether_type = old_eth_hdr->ether_type;
-                            rte_ether_addr_copy(&old_eth_hdr->s_addr, &new_eth_hdr->s_addr);
-                            rte_ether_addr_copy(&old_eth_hdr->d_addr, &new_eth_hdr->d_addr);
-                            pkt->packet_type = RTE_PTYPE_L2_ETHER | RTE_PTYPE_L3_IPV4 | RTE_PTYPE_L4_UDP;
-                            pkt->ol_flags |= ol_flags;
-                            pkt->l2_len = sizeof(struct rte_ether_hdr);
-                            pkt->l3_len = sizeof(struct rte_ipv4_hdr);
-                        }
-                        tx_count += n_fragments;
-                    }
+        // Send the packets whose launch time has come (SO_TXTIME)
+        if (udpdk_txtime_enabled() && tx_release_scheduled(qconf, cur_tsc, tx_frag) > 0) {
+            busy = true;
+        }
+
+        // Send the packets of the high-priority sockets first, without coalescing them
+        if (tx_drain_prio(qconf, cur_tsc, tx_frag) > 0) {
+            busy = true;
+        }
+
+        // Transmit packets to DPDK port 0 (queue 0), serving the sockets with deficit round robin
+        // from a start slot that rotates at every iteration
+        for (k = 0; k < NUM_SOCKETS_MAX; k++) {
+            i = (tx_rr + k) % NUM_SOCKETS_MAX;
+            slot = &exch_slots[i];
+            if (!exch_zone_desc->slots[i].bound) {
+                // Drop the packet held back for a socket that was closed meanwhile
+                if (unlikely(tx_n_pending > 0) && slot->tx_pending != NULL) {
+                    rte_pktmbuf_free(slot->tx_pending);
+                    slot->tx_pending = NULL;
+                    slot->tx_deficit = 0;
+                    tx_n_pending--;
                 }
-                // If a batch of packets is ready, send it
-                if (tx_count >= BURST_SIZE) {
-                    flush_tx_table(tx_mbuf_table, tx_count);
+                continue;
+            }
+            // The high-priority sockets are only served by tx_drain_prio(), on their own TX queue
+            if (unlikely(__atomic_load_n(&exch_zone_desc->prio_socks[i / 64], __ATOMIC_RELAXED)
+                    & (1ULL << (i % 64)))) {
+                continue;
+            }
+            tx_rate_reload(slot, &exch_zone_desc->slots[i]);
+            slot->tx_deficit += exch_zone_desc->slots[i].tx_weight * tx_quantum;
+            while (1) {
+                // If a batch of packets is ready, send it (this also leaves room for the next GSO/fragments)
+                if (tx_count >= config.tx_burst) {
+                    flush_tx_table(tx_mbuf_table, tx_count, QUEUE_TX);
                     tx_count = 0;
+                    tx_flush.deadline = 0;
+                }
+                // Take the packet held back in the last round, or dequeue one (move to next slot if empty)
+                pkt = tx_next_pkt(slot, i, cur_tsc, &held);
+                if (pkt == NULL) {
+                    slot->tx_deficit = 0;   // an idle socket does not accumulate credit
+                    break;
+                }
+                // Keep the packet for the next round if the socket used up its quantum
+                if (pkt->pkt_len > slot->tx_deficit) {
+                    tx_hold_pkt(slot, pkt);
+                    busy = true;
+                    break;
+                }
+                // Or until the socket has the tokens to send it (it does not use its share meanwhile)
+                if (unlikely(slot->tx_limited) && !tx_rate_conform(slot, pkt, cur_tsc)) {
+                    tx_throttle_pkt(slot, i, pkt, held);
+                    slot->tx_deficit = 0;
+                    break;
                 }
+                slot->tx_deficit -= pkt->pkt_len;
+                busy = true;
+                tx_dequeued++;
+                n = tx_submit_pkt(pkt, i, tx_mbuf_table, tx_count, qconf, cur_tsc, tx_frag);
+                if (unlikely(n < 0)) {
+                    break;
+                }
+                tx_count += n;
             }
         }
-        // Flush remaining packets (otherwise we'd need a timeout to ensure progress for sporadic traffic)
-        if (tx_count > 0) {
-            flush_tx_table(tx_mbuf_table, tx_count);
+        tx_rr = (tx_rr + 1) % NUM_SOCKETS_MAX;
+        // Flush the remaining packets now, or keep them to fill the burst (up to tx_flush_us)
+        if (tx_flush_due(&tx_flush, tx_count, tx_dequeued, cur_tsc)) {
+            flush_tx_table(tx_mbuf_table, tx_count, QUEUE_TX);
             tx_count = 0;
+            tx_flush.deadline = 0;
+        }
+        PROF_MARK(UDPDK_STAGE_TX_DEQUEUE);
+
+        // If some sockets under backpressure still hold back packets, retry delivering them and
+        // stop receiving until they succeed (packets will pile up in the NIC queue meanwhile)
+        if (unlikely(rx_backlog > 0)) {
+            rx_backlog = flush_rx_queues();
+            PROF_MARK(UDPDK_STAGE_RX_FLUSH);
+            if (rx_backlog > 0) {
+                PROF_LOOP_END(cur_tsc, busy);
+                continue;
+            }
         }
 
         // Receive packets from DPDK port 0 (queue 0)   TODO use more queues (RSS)
         rx_count = rte_eth_rx_burst(PORT_RX, QUEUE_RX, rx_mbuf_table, RX_MBUF_TABLE_SIZE);
+        PROF_MARK(UDPDK_STAGE_RX_BURST);
 
         if (likely(rx_count > 0)) {
-            // Prefetch some packets (to reduce cache misses later)
-            for (j = 0; j < PREFETCH_OFFSET && j < rx_count; j++) {
-                rte_prefetch0(rte_pktmbuf_mtod(rx_mbuf_table[j], void *));
+            busy = true;
+            if (udpdk_tstamp_enabled()) {
+                tstamp_rx_burst(rx_mbuf_table, rx_count);
             }
-
-            // Prefetch the remaining packets, and reassemble the first ones
-            for (j = 0; j < (rx_count - PREFETCH_OFFSET); j++) {
-                rte_prefetch0(rte_pktmbuf_mtod(rx_mbuf_table[j + PREFETCH_OFFSET], void *));
-                reassemble(rx_mbuf_table[j], PORT_RX, QUEUE_RX, qconf, cur_tsc);
+            if (udpdk_trace_enabled()) {
+                trace_rx_burst(rx_mbuf_table, rx_count);
             }
+            poller_stats->rxq[QUEUE_RX].pkts += rx_count;
+            poller_stats->rxq[QUEUE_RX].bursts++;
 
-            // Reassemble the second batch of fragments
-            for (; j < rx_count; j++) {
-                reassemble(rx_mbuf_table[j], PORT_RX, QUEUE_RX, qconf, cur_tsc);
-            }
+            rx_process_burst(rx_mbuf_table, rx_count, qconf, cur_tsc, rx_reasm, shared_ports);
+            PROF_MARK(UDPDK_STAGE_RX_PROCESS);
 
             // Effectively flush the packets to exchange buffers
-            for (i = 0; i < NUM_SOCKETS_MAX; i++) {
-                if (exch_zone_desc->slots[i].used) {
-                    flush_rx_queue(i);
-                }
-            }
+            rx_backlog = flush_rx_queues();
 
             // Free death row
-            rte_ip_frag_free_death_row(&qconf->death_row, PREFETCH_OFFSET);
+            if (rx_reasm) {
+                rte_ip_frag_free_death_row(&qconf->death_row, PREFETCH_OFFSET);
+            }
+            PROF_MARK(UDPDK_STAGE_RX_FLUSH);
         }
+        PROF_LOOP_END(cur_tsc, busy);
     }
+}
+
+#define POLLER_VARIANT(frag, reasm, shared) \
+    static void poller_loop_##frag##reasm##shared(void) { poller_loop(frag, reasm, shared); }
+
+POLLER_VARIANT(0, 0, 0)
+POLLER_VARIANT(0, 0, 1)
+POLLER_VARIANT(0, 1, 0)
+POLLER_VARIANT(0, 1, 1)
+POLLER_VARIANT(1, 0, 0)
+POLLER_VARIANT(1, 0, 1)
+POLLER_VARIANT(1, 1, 0)
+POLLER_VARIANT(1, 1, 1)
+
+// Indexed by tx_frag, rx_reasm, shared_ports
+static void (* const poller_variants[2][2][2])(void) = {
+    {{poller_loop_000, poller_loop_001}, {poller_loop_010, poller_loop_011}},
+    {{poller_loop_100, poller_loop_101}, {poller_loop_110, poller_loop_111}},
+};
+
+/* Packet polling routine */
+void poller_body(void)
+{
+    RTE_LOG(INFO, POLLBODY, "Polling with fragmentation %s, reassembly %s, shared ports %s\n",
+            config.tx_frag ? "on" : "off", config.rx_reasm ? "on" : "off", config.shared_ports ? "on" : "off");
+    __atomic_store_n(&exch_zone_desc->poller_running, 1, __ATOMIC_SEQ_CST);
+    poller_variants[!!config.tx_frag][!!config.rx_reasm][!!config.shared_ports]();
+    __atomic_store_n(&exch_zone_desc->poller_running, 0, __ATOMIC_SEQ_CST);
+
     // Exit directly to avoid returning in the application main (as we forked)
     RTE_LOG(INFO, POLLBODY, "Polling process exiting.\n");
     exit(0);
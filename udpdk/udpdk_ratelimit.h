@@ -0,0 +1,92 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+// Token bucket timed with the TSC, to bound the rate of an event
+// (e.g. log messages on the packet path, or the transmissions of a socket)
+//
+
+#ifndef UDPDK_RATELIMIT_H
+#define UDPDK_RATELIMIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+
+struct token_bucket {
+    uint64_t rate;          // tokens per second
+    uint64_t burst;         // maximum number of tokens
+    uint64_t tokens;        // tokens currently available
+    uint64_t hz;            // TSC frequency
+    uint64_t fill_cycles;   // cycles needed to fill an empty bucket
+    uint64_t last_tsc;      // time of the last refill
+};
+
+/* Initialize a (full) token bucket */
+static inline void tb_init(struct token_bucket *tb, uint64_t rate, uint64_t burst)
+{
+    tb->rate = rate;
+    tb->burst = burst;
+    tb->tokens = burst;
+    tb->hz = rte_get_tsc_hz();
+    tb->fill_cycles = burst * tb->hz / rate;
+    tb->last_tsc = rte_rdtsc();
+}
+
+/* Add the tokens earned since the last refill */
+static inline void tb_refill(struct token_bucket *tb, uint64_t now)
+{
+    uint64_t elapsed = now - tb->last_tsc;
+    uint64_t new_tokens;
+
+    // Nothing to add while the bucket repays a debt (see tb_borrow)
+    if ((int64_t)elapsed <= 0) {
+        return;
+    }
+    if (elapsed >= tb->fill_cycles) {
+        tb->tokens = tb->burst;
+        tb->last_tsc = now;
+        return;
+    }
+    new_tokens = elapsed * tb->rate / tb->hz;
+    if (new_tokens == 0) {
+        return;
+    }
+    tb->tokens = RTE_MIN(tb->tokens + new_tokens, tb->burst);
+    // Advance by the time corresponding to the tokens, not to 'now', to not lose fractions of token
+    tb->last_tsc += new_tokens * tb->hz / tb->rate;
+}
+
+/* Take n tokens from the bucket, if available */
+static inline bool tb_consume(struct token_bucket *tb, uint64_t n, uint64_t now)
+{
+    tb_refill(tb, now);
+    if (tb->tokens < n) {
+        return false;
+    }
+    tb->tokens -= n;
+    return true;
+}
+
+/* Refill the bucket and tell whether it holds any token */
+static inline bool tb_ready(struct token_bucket *tb, uint64_t now)
+{
+    tb_refill(tb, now);
+    return tb->tokens > 0;
+}
+
+/* Take n tokens, borrowing the missing ones from the next refills: the bucket stays empty until the debt
+ * is repaid, so that requests larger than the burst are delayed in proportion rather than refused */
+static inline void tb_borrow(struct token_bucket *tb, uint64_t n)
+{
+    if (tb->tokens >= n) {
+        tb->tokens -= n;
+        return;
+    }
+    tb->last_tsc += (n - tb->tokens) * tb->hz / tb->rate;
+    tb->tokens = 0;
+}
+
+#endif  // UDPDK_RATELIMIT_H
@@ -0,0 +1,244 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+// Parsing of the headers of RX bursts, to pick the datagrams for the fast
+// path of the poller and gather their destinations for the demux. Besides
+// the scalar parser, the SSE4.2 and AVX2 ones check 4 and 8 packets at once;
+// the best one supported by the CPU is selected at runtime.
+//
+
+#include <string.h>
+
+#include <rte_byteorder.h>
+#include <rte_common.h>
+#include <rte_cpuflags.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+#include <rte_prefetch.h>
+#include <rte_udp.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "udpdk_rx_parse.h"
+
+// Offsets (in the frame) of the 32-bit words compared by the vector parsers
+#define RX_PARSE_OFF_ETYPE  12      // ether_type, version_ihl, type_of_service
+#define RX_PARSE_OFF_FRAG   20      // fragment_offset, time_to_live, next_proto_id
+#define RX_PARSE_OFF_DADDR  30      // dst_addr
+#define RX_PARSE_OFF_DPORT  36      // dst_port, dgram_len
+
+// Masks and expected values of those words, as loaded by a little-endian CPU
+#define RX_PARSE_ETYPE_MASK 0x00ffffff
+#define RX_PARSE_ETYPE_VAL  0x00450008      // IPv4, no options
+#define RX_PARSE_FRAG_MASK  0xff00ff3f      // MF flag and fragment offset, protocol
+#define RX_PARSE_FRAG_VAL   0x11000000      // unfragmented, UDP
+
+// Read by the vector parsers in place of the packets too short to hold the headers
+static const uint8_t rx_parse_zero[64] __rte_aligned(64);
+
+/* Prefetch the first packets of a burst: the headers of the first pf, and the mbufs of the next pf */
+static inline void rx_parse_prefetch_start(struct rte_mbuf **pkts, uint16_t n, uint16_t pf)
+{
+    uint16_t k;
+
+    for (k = 0; k < pf && k < n; k++) {
+        rte_prefetch0(rte_pktmbuf_mtod(pkts[k], void *));
+    }
+    for (; k < 2 * pf && k < n; k++) {
+        rte_prefetch0(pkts[k]);
+    }
+}
+
+/* Software pipeline for the cnt packets from i: prefetch the mbufs 2*pf packets ahead and, as their
+ * data pointers were fetched one stage earlier, the headers pf packets ahead */
+static inline void rx_parse_prefetch(struct rte_mbuf **pkts, uint16_t i, uint16_t n, uint16_t pf, uint16_t cnt)
+{
+    uint16_t k;
+
+    if (pf == 0) {
+        return;
+    }
+    for (k = i + pf; k < i + pf + cnt && k < n; k++) {
+        rte_prefetch0(rte_pktmbuf_mtod(pkts[k], void *));
+    }
+    for (k = i + 2 * pf; k < i + 2 * pf + cnt && k < n; k++) {
+        rte_prefetch0(pkts[k]);
+    }
+}
+
+static void rx_parse_scalar(struct rte_mbuf **pkts, uint16_t n, uint8_t *fast,
+        uint32_t *dst_addr, uint16_t *dst_port, uint16_t pf)
+{
+    struct rte_ether_hdr *eth_hdr;
+    struct rte_ipv4_hdr *ip_hdr;
+    struct rte_udp_hdr *udp_hdr;
+    uint16_t i;
+
+    rx_parse_prefetch_start(pkts, n, pf);
+    for (i = 0; i < n; i++) {
+        rx_parse_prefetch(pkts, i, n, pf, 1);
+        eth_hdr = rte_pktmbuf_mtod(pkts[i], struct rte_ether_hdr *);
+        ip_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+        udp_hdr = (struct rte_udp_hdr *)(ip_hdr + 1);
+        fast[i] = pkts[i]->data_len >= RX_PARSE_MIN_LEN
+                && eth_hdr->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)
+                && ip_hdr->version_ihl == IP_VHL_DEF
+                && !(ip_hdr->fragment_offset & rte_cpu_to_be_16(RTE_IPV4_HDR_MF_FLAG | RTE_IPV4_HDR_OFFSET_MASK))
+                && ip_hdr->next_proto_id == IPPROTO_UDP;
+        dst_addr[i] = ip_hdr->dst_addr;
+        dst_port[i] = udp_hdr->dst_port;
+    }
+}
+
+#if defined(__x86_64__)
+
+/* Load a 32-bit word of the headers of a packet */
+static inline int32_t rx_parse_word(const uint8_t *data, unsigned off)
+{
+    int32_t w;
+
+    memcpy(&w, data + off, sizeof(w));
+    return w;
+}
+
+__attribute__((target("sse4.2")))
+static void rx_parse_sse42(struct rte_mbuf **pkts, uint16_t n, uint8_t *fast,
+        uint32_t *dst_addr, uint16_t *dst_port, uint16_t pf)
+{
+    const __m128i etype_mask = _mm_set1_epi32(RX_PARSE_ETYPE_MASK);
+    const __m128i etype_val = _mm_set1_epi32(RX_PARSE_ETYPE_VAL);
+    const __m128i frag_mask = _mm_set1_epi32(RX_PARSE_FRAG_MASK);
+    const __m128i frag_val = _mm_set1_epi32(RX_PARSE_FRAG_VAL);
+    const __m128i port_mask = _mm_set1_epi32(0xffff);
+    const uint8_t *d[4];
+    __m128i etype, frag, daddr, dport, ok;
+    int mask, k;
+    uint16_t i;
+
+    rx_parse_prefetch_start(pkts, n, pf);
+    for (i = 0; i + 4 <= n; i += 4) {
+        rx_parse_prefetch(pkts, i, n, pf, 4);
+        for (k = 0; k < 4; k++) {
+            d[k] = pkts[i + k]->data_len >= RX_PARSE_MIN_LEN
+                    ? rte_pktmbuf_mtod(pkts[i + k], const uint8_t *) : rx_parse_zero;
+        }
+#define RX_PARSE_LOAD4(off) _mm_set_epi32(rx_parse_word(d[3], off), rx_parse_word(d[2], off), \
+                                          rx_parse_word(d[1], off), rx_parse_word(d[0], off))
+        etype = RX_PARSE_LOAD4(RX_PARSE_OFF_ETYPE);
+        frag = RX_PARSE_LOAD4(RX_PARSE_OFF_FRAG);
+        daddr = RX_PARSE_LOAD4(RX_PARSE_OFF_DADDR);
+        dport = RX_PARSE_LOAD4(RX_PARSE_OFF_DPORT);
+#undef RX_PARSE_LOAD4
+        ok = _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(etype, etype_mask), etype_val),
+                           _mm_cmpeq_epi32(_mm_and_si128(frag, frag_mask), frag_val));
+        mask = _mm_movemask_ps(_mm_castsi128_ps(ok));
+        _mm_storeu_si128((__m128i *)&dst_addr[i], daddr);
+        dport = _mm_and_si128(dport, port_mask);
+        _mm_storel_epi64((__m128i *)&dst_port[i], _mm_packus_epi32(dport, dport));
+        for (k = 0; k < 4; k++) {
+            fast[i + k] = (mask >> k) & 1;
+        }
+    }
+    if (i < n) {
+        rx_parse_scalar(&pkts[i], n - i, &fast[i], &dst_addr[i], &dst_port[i], 0);
+    }
+}
+
+__attribute__((target("avx2")))
+static void rx_parse_avx2(struct rte_mbuf **pkts, uint16_t n, uint8_t *fast,
+        uint32_t *dst_addr, uint16_t *dst_port, uint16_t pf)
+{
+    const __m256i etype_mask = _mm256_set1_epi32(RX_PARSE_ETYPE_MASK);
+    const __m256i etype_val = _mm256_set1_epi32(RX_PARSE_ETYPE_VAL);
+    const __m256i frag_mask = _mm256_set1_epi32(RX_PARSE_FRAG_MASK);
+    const __m256i frag_val = _mm256_set1_epi32(RX_PARSE_FRAG_VAL);
+    const __m256i port_mask = _mm256_set1_epi32(0xffff);
+    const uint8_t *d[8];
+    __m256i etype, frag, daddr, dport, ok;
+    int mask, k;
+    uint16_t i;
+
+    rx_parse_prefetch_start(pkts, n, pf);
+    for (i = 0; i + 8 <= n; i += 8) {
+        rx_parse_prefetch(pkts, i, n, pf, 8);
+        for (k = 0; k < 8; k++) {
+            d[k] = pkts[i + k]->data_len >= RX_PARSE_MIN_LEN
+                    ? rte_pktmbuf_mtod(pkts[i + k], const uint8_t *) : rx_parse_zero;
+        }
+        // Hardware gathers are slower than separate loads here (see apps/rxbench)
+#define RX_PARSE_LOAD8(off) _mm256_set_epi32(rx_parse_word(d[7], off), rx_parse_word(d[6], off), \
+                                             rx_parse_word(d[5], off), rx_parse_word(d[4], off), \
+                                             rx_parse_word(d[3], off), rx_parse_word(d[2], off), \
+                                             rx_parse_word(d[1], off), rx_parse_word(d[0], off))
+        etype = RX_PARSE_LOAD8(RX_PARSE_OFF_ETYPE);
+        frag = RX_PARSE_LOAD8(RX_PARSE_OFF_FRAG);
+        daddr = RX_PARSE_LOAD8(RX_PARSE_OFF_DADDR);
+        dport = RX_PARSE_LOAD8(RX_PARSE_OFF_DPORT);
+#undef RX_PARSE_LOAD8
+        ok = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(etype, etype_mask), etype_val),
+                              _mm256_cmpeq_epi32(_mm256_and_si256(frag, frag_mask), frag_val));
+        mask = _mm256_movemask_ps(_mm256_castsi256_ps(ok));
+        _mm256_storeu_si256((__m256i *)&dst_addr[i], daddr);
+        // Pack the ports to 16 bits (per 128-bit lane), then join the two lanes
+        dport = _mm256_and_si256(dport, port_mask);
+        dport = _mm256_permute4x64_epi64(_mm256_packus_epi32(dport, dport), 0x08);
+        _mm_storeu_si128((__m128i *)&dst_port[i], _mm256_castsi256_si128(dport));
+        for (k = 0; k < 8; k++) {
+            fast[i + k] = (mask >> k) & 1;
+        }
+    }
+    if (i < n) {
+        rx_parse_scalar(&pkts[i], n - i, &fast[i], &dst_addr[i], &dst_port[i], 0);
+    }
+}
+
+#endif  // __x86_64__
+
+/* Return the parser, or NULL if the CPU does not support it; UDPDK_RX_PARSER_AUTO is resolved to the best one */
+udpdk_rx_parse_t udpdk_rx_parse_select(enum udpdk_rx_parser *parser)
+{
+#if defined(__x86_64__)
+    if (*parser == UDPDK_RX_PARSER_AUTO) {
+        if (rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2) > 0) {
+            *parser = UDPDK_RX_PARSER_AVX2;
+        } else if (rte_cpu_get_flag_enabled(RTE_CPUFLAG_SSE4_2) > 0) {
+            *parser = UDPDK_RX_PARSER_SSE42;
+        } else {
+            *parser = UDPDK_RX_PARSER_SCALAR;
+        }
+    }
+    switch (*parser) {
+        case UDPDK_RX_PARSER_AVX2:
+            return rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2) > 0 ? rx_parse_avx2 : NULL;
+        case UDPDK_RX_PARSER_SSE42:
+            return rte_cpu_get_flag_enabled(RTE_CPUFLAG_SSE4_2) > 0 ? rx_parse_sse42 : NULL;
+        default:
+            return rx_parse_scalar;
+    }
+#else
+    if (*parser == UDPDK_RX_PARSER_AUTO) {
+        *parser = UDPDK_RX_PARSER_SCALAR;
+    }
+    return *parser == UDPDK_RX_PARSER_SCALAR ? rx_parse_scalar : NULL;
+#endif
+}
+
+const char *udpdk_rx_parser_name(enum udpdk_rx_parser parser)
+{
+    switch (parser) {
+        case UDPDK_RX_PARSER_AUTO:
+            return "auto";
+        case UDPDK_RX_PARSER_SCALAR:
+            return "scalar";
+        case UDPDK_RX_PARSER_SSE42:
+            return "sse4.2";
+        case UDPDK_RX_PARSER_AVX2:
+            return "avx2";
+        default:
+            return "unknown";
+    }
+}
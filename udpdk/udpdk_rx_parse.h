@@ -0,0 +1,28 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+
+#ifndef UDPDK_RX_PARSE_H
+#define UDPDK_RX_PARSE_H
+
+#include <stdint.h>
+
+#include <rte_mbuf.h>
+
+#include "udpdk_types.h"
+
+// Bytes of headers read by the parsers (Ethernet, IPv4 without options, UDP)
+#define RX_PARSE_MIN_LEN    (sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr))
+
+/* Parse the headers of a burst: fast[i] tells whether pkts[i] is an unfragmented UDP datagram over IPv4
+ * without options, in which case dst_addr[i] and dst_port[i] hold its destination (network byte order).
+ * The mbufs and headers are prefetched pf packets apart (0: no prefetching) */
+typedef void (*udpdk_rx_parse_t)(struct rte_mbuf **pkts, uint16_t n, uint8_t *fast,
+        uint32_t *dst_addr, uint16_t *dst_port, uint16_t pf);
+
+udpdk_rx_parse_t udpdk_rx_parse_select(enum udpdk_rx_parser *parser);
+
+const char *udpdk_rx_parser_name(enum udpdk_rx_parser parser);
+
+#endif  // UDPDK_RX_PARSE_H
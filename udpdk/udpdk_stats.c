@@ -0,0 +1,371 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+// Statistics API, and its exposure through DPDK telemetry
+// (e.g. usertools/dpdk-telemetry.py, then /udpdk/stats)
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
+#include <rte_ethdev.h>
+#include <rte_log.h>
+#include <rte_memcpy.h>
+#include <rte_mempool.h>
+#include <rte_ring.h>
+#include <rte_telemetry.h>
+
+#include "udpdk_api.h"
+#include "udpdk_stats.h"
+#include "udpdk_trace.h"
+
+#define RTE_LOGTYPE_STATS RTE_LOGTYPE_USER1
+
+extern struct exch_zone_info *exch_zone_desc;
+extern struct udpdk_poller_stats *poller_stats;
+extern struct rte_mempool *rx_pktmbuf_pool;
+extern struct rte_mempool *tx_pktmbuf_pool;
+
+static const char *drop_reason_names[UDPDK_DROP_REASONS] = {
+    [UDPDK_DROP_NOT_IPV4] = "drop_not_ipv4",
+    [UDPDK_DROP_NOT_UDP] = "drop_not_udp",
+    [UDPDK_DROP_NO_BINDING] = "drop_no_binding",
+    [UDPDK_DROP_NO_MATCH] = "drop_no_match",
+    [UDPDK_DROP_NO_MBUF] = "drop_no_mbuf",
+    [UDPDK_DROP_BAD_IP_CKSUM] = "drop_bad_ip_cksum",
+    [UDPDK_DROP_BAD_UDP_CKSUM] = "drop_bad_udp_cksum",
+    [UDPDK_DROP_FRAG_SRC_CAP] = "drop_frag_src_cap",
+    [UDPDK_DROP_FRAG_DISABLED] = "drop_frag_disabled",
+};
+
+static const char *lat_stage_names[UDPDK_LAT_STAGES] = {
+    [UDPDK_LAT_RX_POLLER] = "rx_poller",
+    [UDPDK_LAT_RX_QUEUE] = "rx_queue",
+    [UDPDK_LAT_TX_QUEUE] = "tx_queue",
+    [UDPDK_LAT_TX_POLLER] = "tx_poller",
+};
+
+static const char *stage_names[UDPDK_STAGES] = {
+    [UDPDK_STAGE_TX_DEQUEUE] = "tx_dequeue",
+    [UDPDK_STAGE_TX_FRAG] = "tx_frag",
+    [UDPDK_STAGE_TX_BURST] = "tx_burst",
+    [UDPDK_STAGE_RX_BURST] = "rx_burst",
+    [UDPDK_STAGE_RX_PROCESS] = "rx_process",
+    [UDPDK_STAGE_RX_FLUSH] = "rx_flush",
+};
+
+
+/* Read the counters of a socket, and the current occupancy of its rings (0 if the socket is being closed) */
+void udpdk_read_sock_stats(int sockfd, struct udpdk_sock_stats *stats)
+{
+    struct rte_ring *rx_q, *tx_q;
+
+    rte_memcpy(stats, &exch_zone_desc->slots[sockfd].stats, sizeof(*stats));
+    // close() may release the rings concurrently: read each pointer once
+    rx_q = __atomic_load_n(&exch_zone_desc->slots[sockfd].rx_q, __ATOMIC_ACQUIRE);
+    tx_q = __atomic_load_n(&exch_zone_desc->slots[sockfd].tx_q, __ATOMIC_ACQUIRE);
+    stats->rx_queued = (rx_q != NULL) ? rte_ring_count(rx_q) : 0;
+    stats->tx_queued = (tx_q != NULL) ? rte_ring_count(tx_q) : 0;
+}
+
+/* Get a snapshot of the counters of a socket */
+int udpdk_get_sock_stats(int sockfd, struct udpdk_sock_stats *stats)
+{
+    if (sockfd < 0 || sockfd >= NUM_SOCKETS_MAX) {
+        errno = ENOTSOCK;
+        return -1;
+    }
+    if (!exch_zone_desc->slots[sockfd].used) {
+        errno = EBADF;
+        RTE_LOG(ERR, STATS, "Invalid socket descriptor (%d)\n", sockfd);
+        return -1;
+    }
+    if (stats == NULL) {
+        errno = EFAULT;
+        return -1;
+    }
+    udpdk_read_sock_stats(sockfd, stats);
+    return 0;
+}
+
+/* Get a snapshot of the latency histograms of a socket (all zero unless latency_trace is enabled) */
+int udpdk_get_sock_latency(int sockfd, struct udpdk_sock_latency *lat)
+{
+    if (sockfd < 0 || sockfd >= NUM_SOCKETS_MAX) {
+        errno = ENOTSOCK;
+        return -1;
+    }
+    if (!exch_zone_desc->slots[sockfd].used) {
+        errno = EBADF;
+        RTE_LOG(ERR, STATS, "Invalid socket descriptor (%d)\n", sockfd);
+        return -1;
+    }
+    if (lat == NULL) {
+        errno = EFAULT;
+        return -1;
+    }
+    lat->tsc_hz = rte_get_tsc_hz();
+    rte_memcpy(lat->stage, exch_zone_desc->slots[sockfd].latency, sizeof(lat->stage));
+    return 0;
+}
+
+/* Register the dynamic mbuf field holding the trace stamps (or find it, if already registered) */
+int udpdk_trace_init(void)
+{
+    static const struct rte_mbuf_dynfield trace_dynfield_desc = {
+        .name = UDPDK_TRACE_DYNFIELD_NAME,
+        .size = sizeof(struct udpdk_mbuf_trace),
+        .align = __alignof__(struct udpdk_mbuf_trace),
+    };
+
+    udpdk_trace_offset = rte_mbuf_dynfield_register(&trace_dynfield_desc);
+    if (udpdk_trace_offset < 0) {
+        RTE_LOG(ERR, STATS, "Cannot register the mbuf field for latency tracing: %s\n",
+                rte_strerror(rte_errno));
+        return -1;
+    }
+    RTE_LOG(INFO, STATS, "Latency tracing enabled\n");
+    return 0;
+}
+
+/* Get a snapshot of the global counters (poller, NIC and mbuf pools) */
+int udpdk_get_stats(struct udpdk_stats *stats)
+{
+    if (stats == NULL) {
+        errno = EFAULT;
+        return -1;
+    }
+    rte_memcpy(&stats->poller, poller_stats, sizeof(stats->poller));
+    if (rte_eth_stats_get(PORT_RX, &stats->port) != 0) {
+        memset(&stats->port, 0, sizeof(stats->port));
+    }
+    stats->rx_pool_in_use = rte_mempool_in_use_count(rx_pktmbuf_pool);
+    stats->tx_pool_in_use = rte_mempool_in_use_count(tx_pktmbuf_pool);
+    stats->n_sockets = 0;
+    for (int s = 0; s < NUM_SOCKETS_MAX; s++) {
+        stats->n_sockets += (exch_zone_desc->slots[s].used != 0);
+    }
+    return 0;
+}
+
+/* Telemetry: global counters */
+static int telemetry_handle_stats(const char *cmd __rte_unused, const char *params __rte_unused,
+        struct rte_tel_data *d)
+{
+    struct udpdk_stats stats;
+    char name[32];
+    unsigned q, r;
+
+    udpdk_get_stats(&stats);
+
+    rte_tel_data_start_dict(d);
+    for (q = 0; q < NUM_QUEUES_MAX; q++) {
+        snprintf(name, sizeof(name), "rxq%u_pkts", q);
+        rte_tel_data_add_dict_u64(d, name, stats.poller.rxq[q].pkts);
+        snprintf(name, sizeof(name), "rxq%u_bytes", q);
+        rte_tel_data_add_dict_u64(d, name, stats.poller.rxq[q].bytes);
+        snprintf(name, sizeof(name), "rxq%u_bursts", q);
+        rte_tel_data_add_dict_u64(d, name, stats.poller.rxq[q].bursts);
+    }
+    for (q = 0; q < NUM_QUEUES_MAX; q++) {
+        snprintf(name, sizeof(name), "txq%u_pkts", q);
+        rte_tel_data_add_dict_u64(d, name, stats.poller.txq[q].pkts);
+        snprintf(name, sizeof(name), "txq%u_bytes", q);
+        rte_tel_data_add_dict_u64(d, name, stats.poller.txq[q].bytes);
+        snprintf(name, sizeof(name), "txq%u_bursts", q);
+        rte_tel_data_add_dict_u64(d, name, stats.poller.txq[q].bursts);
+        snprintf(name, sizeof(name), "txq%u_dropped", q);
+        rte_tel_data_add_dict_u64(d, name, stats.poller.txq[q].dropped);
+        snprintf(name, sizeof(name), "txq%u_flush_timeout", q);
+        rte_tel_data_add_dict_u64(d, name, stats.poller.txq[q].flush_timeout);
+    }
+    for (r = 0; r < UDPDK_DROP_REASONS; r++) {
+        rte_tel_data_add_dict_u64(d, drop_reason_names[r], stats.poller.rx_drops[r]);
+    }
+    rte_tel_data_add_dict_u64(d, "reasm_reassembled", stats.poller.reasm.reassembled);
+    rte_tel_data_add_dict_u64(d, "reasm_frags_timed_out", stats.poller.reasm.frags_timed_out);
+    rte_tel_data_add_dict_u64(d, "reasm_frags_table_full", stats.poller.reasm.frags_table_full);
+    rte_tel_data_add_dict_u64(d, "txtime_scheduled", stats.poller.txtime.scheduled);
+    rte_tel_data_add_dict_u64(d, "txtime_late", stats.poller.txtime.late);
+    rte_tel_data_add_dict_u64(d, "txtime_dropped", stats.poller.txtime.dropped);
+    rte_tel_data_add_dict_u64(d, "port_ipackets", stats.port.ipackets);
+    rte_tel_data_add_dict_u64(d, "port_opackets", stats.port.opackets);
+    rte_tel_data_add_dict_u64(d, "port_imissed", stats.port.imissed);
+    rte_tel_data_add_dict_u64(d, "port_ierrors", stats.port.ierrors);
+    rte_tel_data_add_dict_u64(d, "port_oerrors", stats.port.oerrors);
+    rte_tel_data_add_dict_u64(d, "port_rx_nombuf", stats.port.rx_nombuf);
+    rte_tel_data_add_dict_u64(d, "rx_pool_in_use", stats.rx_pool_in_use);
+    rte_tel_data_add_dict_u64(d, "tx_pool_in_use", stats.tx_pool_in_use);
+    rte_tel_data_add_dict_u64(d, "n_sockets", stats.n_sockets);
+    return 0;
+}
+
+/* Telemetry: cycle accounting of the poller loop (only if built with UDPDK_POLLER_PROFILE) */
+static int telemetry_handle_profile(const char *cmd __rte_unused, const char *params __rte_unused,
+        struct rte_tel_data *d)
+{
+    struct udpdk_poller_profile prof;
+    uint64_t cycles_total, loops_total;
+    char name[32];
+    unsigned st;
+
+    rte_memcpy(&prof, &poller_stats->profile, sizeof(prof));
+    cycles_total = prof.cycles_busy + prof.cycles_empty;
+    loops_total = prof.loops_busy + prof.loops_empty;
+
+    rte_tel_data_start_dict(d);
+    rte_tel_data_add_dict_u64(d, "tsc_hz", prof.tsc_hz);
+    for (st = 0; st < UDPDK_STAGES; st++) {
+        snprintf(name, sizeof(name), "%s_cycles", stage_names[st]);
+        rte_tel_data_add_dict_u64(d, name, prof.stage_cycles[st]);
+    }
+    rte_tel_data_add_dict_u64(d, "loops_busy", prof.loops_busy);
+    rte_tel_data_add_dict_u64(d, "loops_empty", prof.loops_empty);
+    rte_tel_data_add_dict_u64(d, "cycles_busy", prof.cycles_busy);
+    rte_tel_data_add_dict_u64(d, "cycles_empty", prof.cycles_empty);
+    // Share of the poller time spent doing useful work, in per mille
+    rte_tel_data_add_dict_u64(d, "busy_permille",
+            cycles_total ? prof.cycles_busy * 1000 / cycles_total : 0);
+    rte_tel_data_add_dict_u64(d, "cycles_per_busy_loop",
+            prof.loops_busy ? prof.cycles_busy / prof.loops_busy : 0);
+    rte_tel_data_add_dict_u64(d, "loops", loops_total);
+    return 0;
+}
+
+/* Convert cycles to nanoseconds */
+static inline uint64_t cycles_to_ns(uint64_t cycles, uint64_t hz)
+{
+    return (uint64_t)((double)cycles * NS_PER_S / hz);
+}
+
+/* Estimate a percentile (in cycles) from a histogram, as the upper bound of the bucket it falls in */
+static uint64_t lat_hist_percentile(const struct udpdk_lat_hist *h, unsigned pct)
+{
+    uint64_t target, acc = 0;
+    unsigned b;
+
+    if (h->count == 0) {
+        return 0;
+    }
+    target = (h->count * pct + 99) / 100;
+    for (b = 0; b < UDPDK_LAT_BUCKETS - 1; b++) {
+        acc += h->buckets[b];
+        if (acc >= target) {
+            return RTE_MIN((2ULL << b) - 1, h->max_cycles);
+        }
+    }
+    return h->max_cycles;
+}
+
+/* Telemetry: latency of a socket per stage, in nanoseconds (parameter: socket descriptor) */
+static int telemetry_handle_latency(const char *cmd __rte_unused, const char *params,
+        struct rte_tel_data *d)
+{
+    struct udpdk_sock_latency lat;
+    const struct udpdk_lat_hist *h;
+    char name[32];
+    char *end;
+    long sockfd;
+    unsigned st;
+
+    if (params == NULL || *params == '\0') {
+        return -1;
+    }
+    sockfd = strtol(params, &end, 10);
+    if (*end != '\0' || udpdk_get_sock_latency(sockfd, &lat) < 0) {
+        return -1;
+    }
+
+    rte_tel_data_start_dict(d);
+    for (st = 0; st < UDPDK_LAT_STAGES; st++) {
+        h = &lat.stage[st];
+        snprintf(name, sizeof(name), "%s_count", lat_stage_names[st]);
+        rte_tel_data_add_dict_u64(d, name, h->count);
+        snprintf(name, sizeof(name), "%s_mean_ns", lat_stage_names[st]);
+        rte_tel_data_add_dict_u64(d, name,
+                h->count ? cycles_to_ns(h->sum_cycles / h->count, lat.tsc_hz) : 0);
+        snprintf(name, sizeof(name), "%s_p50_ns", lat_stage_names[st]);
+        rte_tel_data_add_dict_u64(d, name, cycles_to_ns(lat_hist_percentile(h, 50), lat.tsc_hz));
+        snprintf(name, sizeof(name), "%s_p99_ns", lat_stage_names[st]);
+        rte_tel_data_add_dict_u64(d, name, cycles_to_ns(lat_hist_percentile(h, 99), lat.tsc_hz));
+        snprintf(name, sizeof(name), "%s_max_ns", lat_stage_names[st]);
+        rte_tel_data_add_dict_u64(d, name, cycles_to_ns(h->max_cycles, lat.tsc_hz));
+    }
+    return 0;
+}
+
+/* Telemetry: list of open sockets */
+static int telemetry_handle_sockets(const char *cmd __rte_unused, const char *params __rte_unused,
+        struct rte_tel_data *d)
+{
+    rte_tel_data_start_array(d, RTE_TEL_INT_VAL);
+    for (int s = 0; s < NUM_SOCKETS_MAX; s++) {
+        if (exch_zone_desc->slots[s].used) {
+            rte_tel_data_add_array_int(d, s);
+        }
+    }
+    return 0;
+}
+
+/* Telemetry: counters of a socket (parameter: socket descriptor) */
+static int telemetry_handle_socket(const char *cmd __rte_unused, const char *params,
+        struct rte_tel_data *d)
+{
+    struct udpdk_sock_stats stats;
+    struct exch_slot_info *slot;
+    struct rte_ring *rx_q, *tx_q;
+    char *end;
+    long sockfd;
+
+    if (params == NULL || *params == '\0') {
+        return -1;
+    }
+    sockfd = strtol(params, &end, 10);
+    if (*end != '\0' || sockfd < 0 || sockfd >= NUM_SOCKETS_MAX || !exch_zone_desc->slots[sockfd].used) {
+        return -1;
+    }
+    slot = &exch_zone_desc->slots[sockfd];
+    udpdk_read_sock_stats(sockfd, &stats);
+    rx_q = __atomic_load_n(&slot->rx_q, __ATOMIC_ACQUIRE);
+    tx_q = __atomic_load_n(&slot->tx_q, __ATOMIC_ACQUIRE);
+
+    rte_tel_data_start_dict(d);
+    rte_tel_data_add_dict_int(d, "bound", slot->bound);
+    rte_tel_data_add_dict_int(d, "port", ntohs(slot->udp_port));
+    rte_tel_data_add_dict_u64(d, "rx_delivered", stats.rx_delivered);
+    rte_tel_data_add_dict_u64(d, "rx_dropped_full", stats.rx_dropped_full);
+    rte_tel_data_add_dict_u64(d, "tx_enqueued", stats.tx_enqueued);
+    rte_tel_data_add_dict_u64(d, "tx_dropped", stats.tx_dropped);
+    rte_tel_data_add_dict_u64(d, "tx_fragmented", stats.tx_fragmented);
+    rte_tel_data_add_dict_u64(d, "tx_gso_segments", stats.tx_gso_segments);
+    rte_tel_data_add_dict_u64(d, "rx_gro_merged", stats.rx_gro_merged);
+    rte_tel_data_add_dict_u64(d, "tx_throttled", stats.tx_throttled);
+    rte_tel_data_add_dict_u64(d, "rx_hold_timeouts", stats.rx_hold_timeouts);
+    rte_tel_data_add_dict_u64(d, "rx_queued", stats.rx_queued);
+    rte_tel_data_add_dict_u64(d, "tx_queued", stats.tx_queued);
+    rte_tel_data_add_dict_u64(d, "rx_capacity", (rx_q != NULL) ? rte_ring_get_capacity(rx_q) : 0);
+    rte_tel_data_add_dict_u64(d, "tx_capacity", (tx_q != NULL) ? rte_ring_get_capacity(tx_q) : 0);
+    return 0;
+}
+
+/* Register the telemetry commands (NIC xstats are already available as /ethdev/xstats) */
+void udpdk_stats_telemetry_init(void)
+{
+    if (rte_telemetry_register_cmd("/udpdk/stats", telemetry_handle_stats,
+                "Returns the counters of the UDPDK poller, NIC port and mbuf pools. Takes no parameters") < 0
+            || rte_telemetry_register_cmd("/udpdk/profile", telemetry_handle_profile,
+                "Returns the cycles spent by the UDPDK poller in each stage. Takes no parameters") < 0
+            || rte_telemetry_register_cmd("/udpdk/sockets", telemetry_handle_sockets,
+                "Returns the list of open UDPDK sockets. Takes no parameters") < 0
+            || rte_telemetry_register_cmd("/udpdk/socket", telemetry_handle_socket,
+                "Returns the counters of a UDPDK socket. Parameters: int sockfd") < 0
+            || rte_telemetry_register_cmd("/udpdk/latency", telemetry_handle_latency,
+                "Returns the latency of the packets of a UDPDK socket in each stage. Parameters: int sockfd") < 0) {
+        RTE_LOG(WARNING, STATS, "Failed to register telemetry commands\n");
+    }
+}
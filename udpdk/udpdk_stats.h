@@ -0,0 +1,15 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+
+#ifndef UDPDK_STATS_H
+#define UDPDK_STATS_H
+
+#include "udpdk_types.h"
+
+void udpdk_read_sock_stats(int sockfd, struct udpdk_sock_stats *stats);
+
+void udpdk_stats_telemetry_init(void);
+
+#endif  // UDPDK_STATS_H
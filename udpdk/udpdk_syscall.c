@@ -5,21 +5,299 @@
 
 #include "errno.h"
 #include <netinet/in.h>
+#include <netinet/udp.h>    // for SOL_UDP, UDP_SEGMENT, UDP_GRO
+#include <sys/uio.h>
+#include <time.h>
+#include <linux/errqueue.h>     // for struct scm_timestamping
+#include <linux/net_tstamp.h>   // for SOF_TIMESTAMPING_*
 
+#include <rte_errno.h>
+#include <rte_ethdev.h>
 #include <rte_log.h>
+#include <rte_pause.h>
+#include <rte_per_lcore.h>
 #include <rte_random.h>
+#include <rte_ring.h>
 
 #include "udpdk_api.h"
 #include "udpdk_bind_table.h"
+#include "udpdk_cksum.h"
+#include "udpdk_frag.h"
+#include "udpdk_stats.h"
+#include "udpdk_timestamp.h"
+#include "udpdk_trace.h"
+#include "udpdk_txtime.h"
 
 #define RTE_LOGTYPE_SYSCALL RTE_LOGTYPE_USER1
 
+/* Flags of SO_TIMESTAMPING that can be honored (RX timestamps only) */
+#define SOF_TIMESTAMPING_SUPPORTED (SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE | \
+                                    SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RAW_HARDWARE)
+
 extern int interrupted;
 extern configuration config;
 extern struct exch_zone_info *exch_zone_desc;
-extern struct exch_slot *exch_slots;
 extern struct rte_mempool *tx_pktmbuf_pool;
 
+/* IPv4 identification of the next datagram sent by this thread (0 until seeded) */
+static RTE_DEFINE_PER_LCORE(uint32_t, ip_id_next);
+
+/* Get the name of the rings of exchange slots */
+static inline const char * get_exch_ring_name(unsigned id, enum exch_ring_func func, unsigned variant)
+{
+    static char buffer[sizeof(EXCH_RX_RING_NAME) + 8];
+
+    if (func == EXCH_RING_RX) {
+        snprintf(buffer, sizeof(buffer), EXCH_RX_RING_NAME, id, variant);
+    } else {
+        snprintf(buffer, sizeof(buffer), EXCH_TX_RING_NAME, id, variant);
+    }
+    return buffer;
+}
+
+/* Get a reference to the RX or TX ring of a socket */
+static inline struct rte_ring **get_exch_ring(int sockfd, enum exch_ring_func func)
+{
+    if (func == EXCH_RING_RX) {
+        return &exch_zone_desc->slots[sockfd].rx_q;
+    } else {
+        return &exch_zone_desc->slots[sockfd].tx_q;
+    }
+}
+
+/* Map a buffer size (bytes, as in SO_RCVBUF/SO_SNDBUF) to the number of entries of a ring */
+static unsigned bufsize_to_ring_size(int bufsize)
+{
+    unsigned entries = ((unsigned)bufsize + EXCH_RING_ENTRY_BYTES - 1) / EXCH_RING_ENTRY_BYTES;
+
+    // A ring can hold (size - 1) packets, and its size must be a power of 2
+    return RTE_MIN(RTE_MAX(rte_align32pow2(entries + 1), EXCH_RING_SIZE_MIN), EXCH_RING_SIZE_MAX);
+}
+
+/* Free a ring, and the packets left inside */
+static void exch_ring_free(struct rte_ring *r)
+{
+    struct rte_mbuf *pkt;
+
+    while (rte_ring_dequeue(r, (void **)&pkt) == 0) {
+        rte_pktmbuf_free(pkt);
+    }
+    rte_ring_free(r);
+}
+
+/* Destroy the RX or TX ring of a socket, freeing the packets left inside */
+static void exch_ring_destroy(int sockfd, enum exch_ring_func func)
+{
+    struct rte_ring **r = get_exch_ring(sockfd, func);
+    struct rte_ring *old_r;
+
+    // Unpublish the ring before releasing it, so that the readers of the stats never see a freed ring
+    old_r = __atomic_exchange_n(r, NULL, __ATOMIC_ACQ_REL);
+    if (old_r == NULL) {
+        return;
+    }
+    exch_ring_free(old_r);
+}
+
+/* Allocate a RX or TX ring for a socket with the given number of entries, for the given RX queue policy */
+static struct rte_ring *exch_ring_alloc(int sockfd, enum exch_ring_func func, unsigned size, int rxq_policy)
+{
+    struct rte_ring *r = NULL;
+    unsigned flags = RING_F_SP_ENQ | RING_F_SC_DEQ;
+    unsigned variant;
+
+    // With drop-head, the poller evicts old packets from the RX ring, so it is a consumer as well as the app
+    if (func == EXCH_RING_RX && rxq_policy == UDPDK_RXQ_DROP_HEAD) {
+        flags = RING_F_SP_ENQ;
+    }
+
+    // The old ring of the socket still exists while a new one replaces it, so take the other name
+    for (variant = 0; variant < 2; variant++) {
+        r = rte_ring_create(get_exch_ring_name(sockfd, func, variant), size, rte_socket_id(), flags);
+        if (r != NULL || rte_errno != EEXIST) {
+            break;
+        }
+    }
+    if (r == NULL) {
+        RTE_LOG(ERR, SYSCALL, "Cannot create %s ring of size %u for socket %d: %s\n",
+                (func == EXCH_RING_RX) ? "RX" : "TX", size, sockfd, rte_strerror(rte_errno));
+    }
+    return r;
+}
+
+/*
+ * Wait for the poller to start two iterations of its loop (if it is running), so that the one in progress
+ * when a socket was unbound is over. The poller only accesses the rings of bound sockets, so afterwards
+ * they can be released.
+ */
+static void wait_poller_quiescent(void)
+{
+    uint64_t epoch = __atomic_load_n(&exch_zone_desc->poller_epoch, __ATOMIC_SEQ_CST);
+
+    while (__atomic_load_n(&exch_zone_desc->poller_running, __ATOMIC_SEQ_CST)
+            && __atomic_load_n(&exch_zone_desc->poller_epoch, __ATOMIC_SEQ_CST) - epoch < 2) {
+        rte_pause();
+    }
+}
+
+/* Create the RX or TX ring of a socket with the given number of entries */
+static int exch_ring_create(int sockfd, enum exch_ring_func func, unsigned size)
+{
+    struct rte_ring **r = get_exch_ring(sockfd, func);
+
+    *r = exch_ring_alloc(sockfd, func, size, exch_zone_desc->slots[sockfd].rxq_policy);
+    return (*r == NULL) ? -1 : 0;
+}
+
+/* Replace the RX or TX ring of a socket with a new one of the given size and RX queue policy (only before
+ * bind); if the new ring can't be created, the socket keeps the old one */
+static int exch_ring_rebuild(int sockfd, enum exch_ring_func func, unsigned new_size, int rxq_policy)
+{
+    struct rte_ring **r = get_exch_ring(sockfd, func);
+    struct rte_ring *new_r, *old_r;
+
+    // The poller accesses the rings of bound sockets, so they can't be replaced anymore
+    if (exch_zone_desc->slots[sockfd].bound) {
+        errno = EINVAL;
+        RTE_LOG(ERR, SYSCALL, "Rings of socket %d can only be reconfigured before bind\n", sockfd);
+        return -1;
+    }
+
+    new_r = exch_ring_alloc(sockfd, func, new_size, rxq_policy);
+    if (new_r == NULL) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    old_r = __atomic_exchange_n(r, new_r, __ATOMIC_ACQ_REL);
+    exch_ring_free(old_r);
+    return 0;
+}
+
+/* Replace the RX or TX ring of a socket with one fitting the given buffer size */
+static int exch_ring_resize(int sockfd, enum exch_ring_func func, int bufsize)
+{
+    unsigned new_size;
+
+    if (bufsize <= 0) {
+        errno = EINVAL;
+        RTE_LOG(ERR, SYSCALL, "Invalid buffer size %d\n", bufsize);
+        return -1;
+    }
+
+    new_size = bufsize_to_ring_size(bufsize);
+    if (new_size == rte_ring_get_size(*get_exch_ring(sockfd, func))) {
+        return 0;
+    }
+    return exch_ring_rebuild(sockfd, func, new_size, exch_zone_desc->slots[sockfd].rxq_policy);
+}
+
+/* Set the policy applied by the poller when the RX ring of a socket is full */
+static int set_rxq_policy(int sockfd, int policy)
+{
+    int old_policy = exch_zone_desc->slots[sockfd].rxq_policy;
+
+    if (policy != UDPDK_RXQ_DROP_TAIL && policy != UDPDK_RXQ_DROP_HEAD && policy != UDPDK_RXQ_BACKPRESSURE) {
+        errno = EINVAL;
+        RTE_LOG(ERR, SYSCALL, "Invalid RX queue policy %d\n", policy);
+        return -1;
+    }
+
+    // Switching from/to drop-head changes the consumers of the RX ring, so the ring must be recreated
+    if ((old_policy == UDPDK_RXQ_DROP_HEAD) != (policy == UDPDK_RXQ_DROP_HEAD)) {
+        if (exch_ring_rebuild(sockfd, EXCH_RING_RX, rte_ring_get_size(exch_zone_desc->slots[sockfd].rx_q),
+                policy) < 0) {
+            return -1;
+        }
+    }
+    exch_zone_desc->slots[sockfd].rxq_policy = policy;
+    return 0;
+}
+
+/* Set the priority of a socket, and mark it as served first by the poller if high enough (SO_PRIORITY) */
+static int set_priority(int sockfd, int priority)
+{
+    uint64_t bit = 1ULL << (sockfd % 64);
+
+    if (priority < 0 || priority > SO_PRIORITY_MAX) {
+        errno = EINVAL;
+        RTE_LOG(ERR, SYSCALL, "Invalid priority %d (must be 0-%d)\n", priority, SO_PRIORITY_MAX);
+        return -1;
+    }
+    exch_zone_desc->slots[sockfd].priority = priority;
+    // Other threads may update the bits of other sockets in the same word
+    if (priority >= config.prio_high) {
+        __atomic_fetch_or(&exch_zone_desc->prio_socks[sockfd / 64], bit, __ATOMIC_RELEASE);
+    } else {
+        __atomic_fetch_and(&exch_zone_desc->prio_socks[sockfd / 64], ~bit, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/* Set the rate limit of the transmissions of a socket, enforced by the poller (UDPDK_SO_TX_RATE) */
+static void set_tx_rate(int sockfd, const struct udpdk_tx_rate *rate)
+{
+    struct udpdk_tx_rate *r = &exch_zone_desc->slots[sockfd].tx_rate;
+
+    *r = *rate;
+    // By default, allow the packets of TX_RATE_BURST_US at the given rate, and at least one max-size frame
+    if (r->bytes_per_sec > 0 && r->burst_bytes == 0) {
+        r->burst_bytes = RTE_MIN(RTE_MAX(r->bytes_per_sec * TX_RATE_BURST_US / US_PER_S,
+                (uint64_t)(config.mtu + RTE_ETHER_HDR_LEN)), (uint64_t)UINT32_MAX);
+    }
+    if (r->pkts_per_sec > 0 && r->burst_pkts == 0) {
+        r->burst_pkts = RTE_MIN(RTE_MAX(r->pkts_per_sec * TX_RATE_BURST_US / US_PER_S, (uint64_t)1),
+                (uint64_t)UINT32_MAX);
+    }
+    // Tell the poller to reload the token buckets
+    __atomic_fetch_add(&exch_zone_desc->slots[sockfd].tx_rate_gen, 1, __ATOMIC_RELEASE);
+}
+
+/* Let the sends of a socket carry a launch time, in nanoseconds of the given clock (SO_TXTIME) */
+static int set_txtime(int sockfd, const struct sock_txtime *txtime)
+{
+    if (!config.txtime) {
+        errno = EOPNOTSUPP;
+        RTE_LOG(ERR, SYSCALL, "Scheduled transmissions are disabled (see txtime in the configuration)\n");
+        return -1;
+    }
+    // The launch times are converted to the TSC when sending, so the clock must be readable by the app
+    if (txtime->clockid != CLOCK_REALTIME && txtime->clockid != CLOCK_MONOTONIC && txtime->clockid != CLOCK_TAI) {
+        errno = EINVAL;
+        RTE_LOG(ERR, SYSCALL, "Unsupported SO_TXTIME clock %d\n", txtime->clockid);
+        return -1;
+    }
+    // Late packets are always sent, and errors are not reported (no error queue)
+    if (txtime->flags != 0) {
+        errno = EINVAL;
+        RTE_LOG(ERR, SYSCALL, "Unsupported SO_TXTIME flags 0x%x\n", txtime->flags);
+        return -1;
+    }
+    exch_zone_desc->slots[sockfd].txtime_clockid = txtime->clockid;
+    exch_zone_desc->slots[sockfd].txtime = 1;
+    return 0;
+}
+
+/* Set the RX timestamps requested by a socket (SO_TIMESTAMPNS, SO_TIMESTAMPING) */
+static int set_tstamp_option(int sockfd, int optname, int value)
+{
+    if (value != 0 && config.rx_timestamp == UDPDK_TSTAMP_NONE) {
+        errno = EOPNOTSUPP;
+        RTE_LOG(ERR, SYSCALL, "RX timestamps are disabled (see rx_timestamp in the configuration)\n");
+        return -1;
+    }
+    if (optname == SO_TIMESTAMPNS) {
+        exch_zone_desc->slots[sockfd].tstamp_ns = (value != 0);
+        return 0;
+    }
+    if (value & ~SOF_TIMESTAMPING_SUPPORTED) {
+        errno = EINVAL;
+        RTE_LOG(ERR, SYSCALL, "Unsupported SO_TIMESTAMPING flags 0x%x\n", value & ~SOF_TIMESTAMPING_SUPPORTED);
+        return -1;
+    }
+    exch_zone_desc->slots[sockfd].tstamp_flags = value;
+    return 0;
+}
+
 static int socket_validate_args(int domain, int type, int protocol)
 {
     // Domain must be AF_INET (IPv4)
@@ -58,13 +336,25 @@ int udpdk_socket(int domain, int type, int protocol)
         errno = ENOBUFS;
         return -1;
     }
-    // Allocate a free sock_id
+    // Allocate a free sock_id (marked as used only once its rings exist)
     for (sock_id = 0; sock_id < NUM_SOCKETS_MAX; sock_id++) {
         if (!exch_zone_desc->slots[sock_id].used) {
-            exch_zone_desc->slots[sock_id].used = 1;
             exch_zone_desc->slots[sock_id].bound = 0;
             exch_zone_desc->slots[sock_id].sockfd = sock_id;
             exch_zone_desc->slots[sock_id].so_options = 0;
+            exch_zone_desc->slots[sock_id].rxq_policy = UDPDK_RXQ_DROP_TAIL;
+            exch_zone_desc->slots[sock_id].tstamp_flags = 0;
+            exch_zone_desc->slots[sock_id].tstamp_ns = 0;
+            exch_zone_desc->slots[sock_id].no_check = 0;
+            exch_zone_desc->slots[sock_id].rxq_ovfl = 0;
+            exch_zone_desc->slots[sock_id].gso_size = 0;
+            exch_zone_desc->slots[sock_id].gro = 0;
+            exch_zone_desc->slots[sock_id].tx_weight = TX_WEIGHT_DEFAULT;
+            exch_zone_desc->slots[sock_id].priority = 0;
+            exch_zone_desc->slots[sock_id].txtime = 0;
+            set_tx_rate(sock_id, &(struct udpdk_tx_rate){0});
+            memset(&exch_zone_desc->slots[sock_id].stats, 0, sizeof(struct udpdk_sock_stats));
+            memset(exch_zone_desc->slots[sock_id].latency, 0, sizeof(exch_zone_desc->slots[sock_id].latency));
             break;
         }
     }
@@ -74,6 +364,14 @@ int udpdk_socket(int domain, int type, int protocol)
         RTE_LOG(ERR, SYSCALL, "Failed to allocate a descriptor for socket (%d)\n", sock_id);
         return -1;
     }
+    // Create the RX and TX rings with the default size (can be changed with SO_RCVBUF/SO_SNDBUF before bind)
+    if (exch_ring_create(sock_id, EXCH_RING_RX, EXCH_RING_SIZE) < 0
+            || exch_ring_create(sock_id, EXCH_RING_TX, EXCH_RING_SIZE) < 0) {
+        exch_ring_destroy(sock_id, EXCH_RING_RX);
+        errno = ENOBUFS;
+        return -1;
+    }
+    __atomic_store_n(&exch_zone_desc->slots[sock_id].used, 1, __ATOMIC_RELEASE);
     // Increment counter in exch_zone_desc
     exch_zone_desc->n_zones_active++;
 
@@ -90,22 +388,66 @@ static int getsetsockopt_validate_args(int sockfd, int level, int optname,
         return -1;
     }
 
-    // Check that level is supported
-    if (level != SOL_SOCKET) {
-        RTE_LOG(ERR, SYSCALL, "Level %d does not exist or is unsupported\n", level);
-        errno = EINVAL;
-        return -1;
-    }
-
-    // Check if option is supported
-    switch (optname) {
-        case SO_REUSEADDR:
+    // Check that level and option are supported
+    switch (level) {
+        case SOL_SOCKET:
+            switch (optname) {
+                case SO_REUSEADDR:
+                    break;
+                case SO_REUSEPORT:
+                    break;
+                case SO_RCVBUF:
+                    break;
+                case SO_SNDBUF:
+                    break;
+                case SO_RXQ_OVFL:
+                    break;
+                case SO_TIMESTAMPNS:
+                    break;
+                case SO_TIMESTAMPING:
+                    break;
+                case SO_NO_CHECK:
+                    break;
+                case SO_PRIORITY:
+                    break;
+                case SO_TXTIME:
+                    break;
+                default:
+                    errno = ENOPROTOOPT;
+                    RTE_LOG(ERR, SYSCALL, "Invalid or unsupported option %d at level %d\n", optname, level);
+                    return -1;
+            }
+            break;
+        case SOL_UDP:
+            switch (optname) {
+                case UDP_SEGMENT:
+                case UDP_GRO:
+                    break;
+                default:
+                    errno = ENOPROTOOPT;
+                    RTE_LOG(ERR, SYSCALL, "Invalid or unsupported option %d at level %d\n", optname, level);
+                    return -1;
+            }
             break;
-        case SO_REUSEPORT:
+        case SOL_UDPDK:
+            switch (optname) {
+                case UDPDK_SO_STATS:
+                    break;
+                case UDPDK_SO_RXQ_POLICY:
+                    break;
+                case UDPDK_SO_TX_WEIGHT:
+                    break;
+                case UDPDK_SO_TX_RATE:
+                    break;
+                default:
+                    errno = ENOPROTOOPT;
+                    RTE_LOG(ERR, SYSCALL, "Invalid or unsupported option %d at level %d\n", optname, level);
+                    return -1;
+            }
             break;
         default:
-            errno = ENOPROTOOPT;
-            RTE_LOG(ERR, SYSCALL, "Invalid or unsupported option %d at level %d\n", optname, level);
+            RTE_LOG(ERR, SYSCALL, "Level %d does not exist or is unsupported\n", level);
+            errno = EINVAL;
             return -1;
     }
 
@@ -135,6 +477,85 @@ int udpdk_getsockopt(int sockfd, int level, int optname, void *optval, socklen_t
                 case SO_REUSEPORT:
                     *(int *)optval = ((exch_zone_desc->slots[sockfd].so_options & SO_REUSEPORT) != 0);
                     break;
+                case SO_RCVBUF:
+                    *(int *)optval = rte_ring_get_capacity(exch_zone_desc->slots[sockfd].rx_q) * EXCH_RING_ENTRY_BYTES;
+                    break;
+                case SO_SNDBUF:
+                    *(int *)optval = rte_ring_get_capacity(exch_zone_desc->slots[sockfd].tx_q) * EXCH_RING_ENTRY_BYTES;
+                    break;
+                case SO_RXQ_OVFL:
+                    *(int *)optval = exch_zone_desc->slots[sockfd].rxq_ovfl;
+                    break;
+                case SO_TIMESTAMPNS:
+                    *(int *)optval = exch_zone_desc->slots[sockfd].tstamp_ns;
+                    break;
+                case SO_TIMESTAMPING:
+                    *(int *)optval = exch_zone_desc->slots[sockfd].tstamp_flags;
+                    break;
+                case SO_NO_CHECK:
+                    *(int *)optval = exch_zone_desc->slots[sockfd].no_check;
+                    break;
+                case SO_PRIORITY:
+                    *(int *)optval = exch_zone_desc->slots[sockfd].priority;
+                    break;
+                case SO_TXTIME:
+                    if (*optlen < sizeof(struct sock_txtime)) {
+                        errno = EINVAL;
+                        RTE_LOG(ERR, SYSCALL, "optlen too short for option %d at level %d\n", optname, level);
+                        return -1;
+                    }
+                    memset(optval, 0, sizeof(struct sock_txtime));
+                    if (exch_zone_desc->slots[sockfd].txtime) {
+                        ((struct sock_txtime *)optval)->clockid = exch_zone_desc->slots[sockfd].txtime_clockid;
+                    }
+                    *optlen = sizeof(struct sock_txtime);
+                    break;
+                default:
+                    errno = ENOPROTOOPT;
+                    RTE_LOG(ERR, SYSCALL, "Invalid or unsupported option %d at level %d\n", optname, level);
+                    return -1;
+            }
+            break;
+        case SOL_UDP:
+            switch (optname) {
+                case UDP_SEGMENT:
+                    *(int *)optval = exch_zone_desc->slots[sockfd].gso_size;
+                    break;
+                case UDP_GRO:
+                    *(int *)optval = exch_zone_desc->slots[sockfd].gro;
+                    break;
+                default:
+                    errno = ENOPROTOOPT;
+                    RTE_LOG(ERR, SYSCALL, "Invalid or unsupported option %d at level %d\n", optname, level);
+                    return -1;
+            }
+            break;
+        case SOL_UDPDK:
+            switch (optname) {
+                case UDPDK_SO_STATS:
+                    if (*optlen < sizeof(struct udpdk_sock_stats)) {
+                        errno = EINVAL;
+                        RTE_LOG(ERR, SYSCALL, "optlen too short for option %d at level %d\n", optname, level);
+                        return -1;
+                    }
+                    udpdk_read_sock_stats(sockfd, (struct udpdk_sock_stats *)optval);
+                    *optlen = sizeof(struct udpdk_sock_stats);
+                    break;
+                case UDPDK_SO_RXQ_POLICY:
+                    *(int *)optval = exch_zone_desc->slots[sockfd].rxq_policy;
+                    break;
+                case UDPDK_SO_TX_WEIGHT:
+                    *(int *)optval = exch_zone_desc->slots[sockfd].tx_weight;
+                    break;
+                case UDPDK_SO_TX_RATE:
+                    if (*optlen < sizeof(struct udpdk_tx_rate)) {
+                        errno = EINVAL;
+                        RTE_LOG(ERR, SYSCALL, "optlen too short for option %d at level %d\n", optname, level);
+                        return -1;
+                    }
+                    *(struct udpdk_tx_rate *)optval = exch_zone_desc->slots[sockfd].tx_rate;
+                    *optlen = sizeof(struct udpdk_tx_rate);
+                    break;
                 default:
                     errno = ENOPROTOOPT;
                     RTE_LOG(ERR, SYSCALL, "Invalid or unsupported option %d at level %d\n", optname, level);
@@ -177,12 +598,99 @@ int udpdk_setsockopt(int sockfd, int level, int optname, const void *optval, soc
                         exch_zone_desc->slots[sockfd].so_options &= ~SO_REUSEPORT;
                     }
                     break;
+                case SO_RCVBUF:
+                    if (exch_ring_resize(sockfd, EXCH_RING_RX, *(int *)optval) < 0) {
+                        return -1;
+                    }
+                    break;
+                case SO_SNDBUF:
+                    if (exch_ring_resize(sockfd, EXCH_RING_TX, *(int *)optval) < 0) {
+                        return -1;
+                    }
+                    break;
+                case SO_TIMESTAMPNS:
+                case SO_TIMESTAMPING:
+                    if (set_tstamp_option(sockfd, optname, *(int *)optval) < 0) {
+                        return -1;
+                    }
+                    break;
+                case SO_NO_CHECK:
+                    exch_zone_desc->slots[sockfd].no_check = (*(int *)optval != 0);
+                    break;
+                case SO_RXQ_OVFL:
+                    exch_zone_desc->slots[sockfd].rxq_ovfl = (*(int *)optval != 0);
+                    break;
+                case SO_PRIORITY:
+                    if (set_priority(sockfd, *(int *)optval) < 0) {
+                        return -1;
+                    }
+                    break;
+                case SO_TXTIME:
+                    if (optlen < sizeof(struct sock_txtime)) {
+                        errno = EINVAL;
+                        RTE_LOG(ERR, SYSCALL, "optlen too short for option %d at level %d\n", optname, level);
+                        return -1;
+                    }
+                    if (set_txtime(sockfd, (const struct sock_txtime *)optval) < 0) {
+                        return -1;
+                    }
+                    break;
+                default:
+                    errno = ENOPROTOOPT;
+                    RTE_LOG(ERR, SYSCALL, "Invalid or unsupported option %d at level %d\n", optname, level);
+                    return -1;
+            }
+            break;
+        case SOL_UDP:
+            switch (optname) {
+                case UDP_SEGMENT:
+                    // Each datagram must fit in the MTU (0 disables segmentation)
+                    if (*(int *)optval < 0 || *(int *)optval > (int)GSO_MAX_SEGSZ(config.mtu)) {
+                        errno = EINVAL;
+                        RTE_LOG(ERR, SYSCALL, "Invalid segment size %d (max %d)\n", *(int *)optval,
+                                (int)GSO_MAX_SEGSZ(config.mtu));
+                        return -1;
+                    }
+                    exch_zone_desc->slots[sockfd].gso_size = *(int *)optval;
+                    break;
+                case UDP_GRO:
+                    exch_zone_desc->slots[sockfd].gro = (*(int *)optval != 0);
+                    break;
                 default:
                     errno = ENOPROTOOPT;
                     RTE_LOG(ERR, SYSCALL, "Invalid or unsupported option %d at level %d\n", optname, level);
                     return -1;
             }
             break;
+        case SOL_UDPDK:
+            switch (optname) {
+                case UDPDK_SO_RXQ_POLICY:
+                    if (set_rxq_policy(sockfd, *(int *)optval) < 0) {
+                        return -1;
+                    }
+                    break;
+                case UDPDK_SO_TX_WEIGHT:
+                    if (*(int *)optval < 1 || *(int *)optval > TX_WEIGHT_MAX) {
+                        errno = EINVAL;
+                        RTE_LOG(ERR, SYSCALL, "Invalid TX weight %d (must be 1-%d)\n", *(int *)optval, TX_WEIGHT_MAX);
+                        return -1;
+                    }
+                    exch_zone_desc->slots[sockfd].tx_weight = *(int *)optval;
+                    break;
+                case UDPDK_SO_TX_RATE:
+                    if (optlen < sizeof(struct udpdk_tx_rate)) {
+                        errno = EINVAL;
+                        RTE_LOG(ERR, SYSCALL, "optlen too short for option %d at level %d\n", optname, level);
+                        return -1;
+                    }
+                    set_tx_rate(sockfd, (const struct udpdk_tx_rate *)optval);
+                    break;
+                default:    // UDPDK_SO_STATS is read-only
+                    errno = ENOPROTOOPT;
+                    RTE_LOG(ERR, SYSCALL, "Invalid or unsupported option %d at level %d\n", optname, level);
+                    return -1;
+            }
+            break;
         default:
             errno = EINVAL;
             RTE_LOG(ERR, SYSCALL, "Level %d does not exist or is unsupported\n", level);
@@ -272,21 +780,173 @@ static int sendto_validate_args(int sockfd, const void *buf, size_t len, int fla
         errno = EINVAL;
         return -1;
     }
+
+    // Check that the payload fits in a datagram
+    if (len > UDP_MAX_PAYLOAD) {
+        errno = EMSGSIZE;
+        return -1;
+    }
     return 0;
 }
 
-ssize_t udpdk_sendto(int sockfd, const void *buf, size_t len, int flags,
-                     const struct sockaddr *dest_addr, socklen_t addrlen)
+/* Fill the IPv4 and UDP checksums of a packet, or request the NIC to do it */
+static inline void set_tx_cksums(struct rte_mbuf *pkt, struct rte_ipv4_hdr *ip_hdr,
+                                 struct rte_udp_hdr *udp_hdr, int no_check)
+{
+    uint64_t offloads = exch_zone_desc->tx_offloads;
+
+    if (offloads & DEV_TX_OFFLOAD_IPV4_CKSUM) {
+        pkt->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+    } else {
+        ip_hdr->hdr_checksum = rte_ipv4_cksum(ip_hdr);
+    }
+    if (no_check) {
+        return;     // the UDP checksum is optional in IPv4
+    }
+    // The NIC can't compute the checksum of a datagram that will be fragmented
+    if ((offloads & DEV_TX_OFFLOAD_UDP_CKSUM) && (pkt->pkt_len <= config.mtu + RTE_ETHER_HDR_LEN)) {
+        pkt->ol_flags |= PKT_TX_IPV4 | PKT_TX_UDP_CKSUM;
+        udp_hdr->dgram_cksum = rte_ipv4_phdr_cksum(ip_hdr, pkt->ol_flags);
+    } else {
+        udp_hdr->dgram_cksum = udpdk_udp_cksum(pkt, ip_hdr, udp_hdr, pkt->l2_len + pkt->l3_len);
+    }
+}
+
+/* Mark a packet to be split into datagrams of gso_size bytes, by the NIC if possible or else by the poller */
+static inline void set_tx_gso(struct rte_mbuf *pkt, struct rte_ipv4_hdr *ip_hdr,
+                              struct rte_udp_hdr *udp_hdr, uint16_t gso_size)
+{
+    pkt->ol_flags |= PKT_TX_IPV4 | PKT_TX_UDP_SEG;
+    pkt->tso_segsz = gso_size;
+    if (exch_zone_desc->tx_offloads & DEV_TX_OFFLOAD_UDP_TSO) {
+        // The NIC fills lengths and checksums of each datagram, starting from the pseudo-header checksum
+        pkt->ol_flags |= PKT_TX_IP_CKSUM;
+        udp_hdr->dgram_cksum = rte_ipv4_phdr_cksum(ip_hdr, pkt->ol_flags);
+    }
+    // Otherwise, the poller builds each datagram with its own checksums
+}
+
+/*
+ * Reserve n consecutive IPv4 identifiers (one per datagram, more for UDP_SEGMENT sends). Each thread
+ * counts from a random start, so the IDs of the datagrams in flight differ without any shared state.
+ */
+static inline uint16_t tx_ip_id(uint16_t n)
+{
+    uint32_t id = RTE_PER_LCORE(ip_id_next);
+
+    if (unlikely(id == 0)) {
+        // Keep a marker above the 16 bits of the ID to tell the seeded counter apart
+        id = (1 << 16) | (uint16_t)rte_rand();
+    }
+    RTE_PER_LCORE(ip_id_next) = (1 << 16) | (uint16_t)(id + n);
+    return (uint16_t)id;
+}
+
+/* Append the payload to a packet, chaining more mbufs when it does not fit in one */
+static int tx_append_payload(struct rte_mbuf *pkt, const void *buf, size_t len)
+{
+    struct rte_mbuf *seg = pkt;
+    struct rte_mbuf *new_seg;
+    const char *src = buf;
+    size_t chunk;
+
+    while (len > 0) {
+        chunk = RTE_MIN((size_t)rte_pktmbuf_tailroom(seg), len);
+        if (chunk == 0) {
+            new_seg = rte_pktmbuf_alloc(tx_pktmbuf_pool);
+            if (new_seg == NULL) {
+                return -1;
+            }
+            seg->next = new_seg;
+            seg = new_seg;
+            pkt->nb_segs++;
+            continue;
+        }
+        rte_memcpy(rte_pktmbuf_mtod_offset(seg, char *, seg->data_len), src, chunk);
+        seg->data_len += chunk;
+        pkt->pkt_len += chunk;
+        src += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/* Fragment a datagram larger than the MTU in the sending thread, and put all its fragments in the TX ring */
+static ssize_t sendto_fragmented(int sockfd, struct rte_mbuf *pkt, size_t len,
+                                 struct rte_mempool *direct_pool, struct rte_mempool *indirect_pool)
+{
+    struct exch_slot_info *slot = &exch_zone_desc->slots[sockfd];
+    struct rte_mbuf *frags[IPV4_MAX_FRAGS];
+    int n_frags;
+    int j;
+
+    n_frags = udpdk_ipv4_fragment(pkt, frags, IPV4_MAX_FRAGS, direct_pool, indirect_pool,
+            exch_zone_desc->tx_offloads);
+    if (n_frags < 0) {
+        RTE_LOG(ERR, SYSCALL, "Sendto failed to fragment the packet\n");
+        errno = ENOBUFS;
+        rte_pktmbuf_free(pkt);
+        return -1;
+    }
+    // Account the datagram once, on its first fragment (as the poller does)
+    if (udpdk_trace_enabled()) {
+        for (j = 0; j < n_frags; j++) {
+            *udpdk_mbuf_trace(frags[j]) = *udpdk_mbuf_trace(pkt);
+            udpdk_mbuf_trace(pkt)->sockfd = -1;
+        }
+    }
+    // All the fragments leave at the launch time of the datagram
+    if (pkt->ol_flags & udpdk_txtime_flag) {
+        for (j = 0; j < n_frags; j++) {
+            frags[j]->ol_flags |= udpdk_txtime_flag;
+            *udpdk_mbuf_txtime(frags[j]) = *udpdk_mbuf_txtime(pkt);
+        }
+    }
+    // The fragments reference the payload of the original mbuf, which can be released
+    rte_pktmbuf_free(pkt);
+    // Shared with the poller, which fragments the packets left whole by the sending threads
+    __atomic_fetch_add(&slot->stats.tx_fragmented, 1, __ATOMIC_RELAXED);
+
+    // Enqueue all the fragments or none (a partial datagram would be discarded by the receiver anyway)
+    if (rte_ring_enqueue_bulk(slot->tx_q, (void **)frags, n_frags, NULL) == 0) {
+        RTE_LOG(ERR, SYSCALL, "Sendto failed to put %d fragments in the TX ring\n  Total: %d  Free: %d\n",
+                n_frags, rte_ring_count(slot->tx_q), rte_ring_free_count(slot->tx_q));
+        slot->stats.tx_dropped++;
+        errno = ENOBUFS;
+        for (j = 0; j < n_frags; j++) {
+            rte_pktmbuf_free(frags[j]);
+        }
+        return -1;
+    }
+    slot->stats.tx_enqueued++;
+
+    return len;
+}
+
+/* Build a datagram with the len bytes of payload gathered from iov, and put it in the TX ring of the socket;
+ * launch_tsc is the TSC from which the poller can send it (SO_TXTIME), or 0 to send it as soon as possible */
+static ssize_t send_datagram(int sockfd, const struct iovec *iov, size_t iovcnt, size_t len,
+                             const struct sockaddr_in *dest_addr_in, uint64_t launch_tsc)
 {
     struct rte_mbuf *pkt;
     struct rte_ether_hdr *eth_hdr;
     struct rte_ipv4_hdr *ip_hdr;
     struct rte_udp_hdr *udp_hdr;
-    void *udp_data;
-    const struct sockaddr_in *dest_addr_in = (struct sockaddr_in *)dest_addr;
+    struct rte_mempool *direct_pool, *indirect_pool;
+    uint16_t gso_size;
+    bool gso;
+    size_t j;
 
-    // Validate the arguments
-    if (sendto_validate_args(sockfd, buf, len, flags, dest_addr, addrlen) < 0) {
+    // With UDP_SEGMENT, a large send is split into multiple datagrams
+    gso_size = exch_zone_desc->slots[sockfd].gso_size;
+    gso = (gso_size > 0) && (len > gso_size);
+    if (gso && (len + gso_size - 1) / gso_size > GSO_MAX_SEGS) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Without fragmentation, each datagram must fit in the MTU
+    if (!config.tx_frag && !gso && len > GSO_MAX_SEGSZ(config.mtu)) {
+        errno = EMSGSIZE;
         return -1;
     }
 
@@ -325,7 +985,7 @@ ssize_t udpdk_sendto(int sockfd, const void *buf, size_t len, int flags,
     ip_hdr->fragment_offset = 0;
     ip_hdr->time_to_live = IP_DEFTTL;
     ip_hdr->next_proto_id = IPPROTO_UDP;
-    ip_hdr->packet_id = 0;
+    ip_hdr->packet_id = rte_cpu_to_be_16(tx_ip_id(gso ? (len + gso_size - 1) / gso_size : 1));
     if ((exch_zone_desc->slots[sockfd].bound)
             && (exch_zone_desc->slots[sockfd].ip_addr.s_addr != INADDR_ANY)) {
         ip_hdr->src_addr = exch_zone_desc->slots[sockfd].ip_addr.s_addr;
@@ -334,39 +994,129 @@ ssize_t udpdk_sendto(int sockfd, const void *buf, size_t len, int flags,
     }
     ip_hdr->dst_addr = dest_addr_in->sin_addr.s_addr;
     ip_hdr->total_length = rte_cpu_to_be_16(len + sizeof(*ip_hdr) + sizeof(*udp_hdr));
-    ip_hdr->hdr_checksum = rte_ipv4_cksum(ip_hdr);
+    ip_hdr->hdr_checksum = 0;
 
     // Initialize the UDP header
     udp_hdr = (struct rte_udp_hdr *)(ip_hdr + 1);
     udp_hdr->src_port = exch_zone_desc->slots[sockfd].udp_port;
     udp_hdr->dst_port = dest_addr_in->sin_port;
-    udp_hdr->dgram_cksum = 0;   // UDP checksum is optional
+    udp_hdr->dgram_cksum = 0;
     udp_hdr->dgram_len = rte_cpu_to_be_16(len + sizeof(*udp_hdr));
 
     // Fill other DPDK metadata
     pkt->packet_type = RTE_PTYPE_L2_ETHER | RTE_PTYPE_L3_IPV4 | RTE_PTYPE_L4_UDP;
-    pkt->pkt_len = len + sizeof(*eth_hdr) + sizeof(*ip_hdr) + sizeof(*udp_hdr);
+    pkt->pkt_len = sizeof(*eth_hdr) + sizeof(*ip_hdr) + sizeof(*udp_hdr);
     pkt->data_len = pkt->pkt_len;
     pkt->l2_len = sizeof(struct rte_ether_hdr);
     pkt->l3_len = sizeof(struct rte_ipv4_hdr);
     pkt->l4_len = sizeof(struct rte_udp_hdr);
 
-    // Write payload
-    udp_data = (void *)(udp_hdr + 1);
-    rte_memcpy(udp_data, buf, len);
+    // Write payload (chaining more mbufs if it does not fit in one)
+    for (j = 0; j < iovcnt; j++) {
+        if (tx_append_payload(pkt, iov[j].iov_base, iov[j].iov_len) < 0) {
+            RTE_LOG(ERR, SYSCALL, "Sendto failed to allocate mbufs for the payload\n");
+            errno = ENOMEM;
+            rte_pktmbuf_free(pkt);
+            return -1;
+        }
+    }
+
+    // Compute the checksums or segment (offloaded to the NIC if possible)
+    if (gso) {
+        set_tx_gso(pkt, ip_hdr, udp_hdr, gso_size);
+    } else {
+        set_tx_cksums(pkt, ip_hdr, udp_hdr, exch_zone_desc->slots[sockfd].no_check);
+    }
+
+    // Stamp the packet, if tracing latency
+    if (udpdk_trace_enabled()) {
+        udpdk_mbuf_trace(pkt)->tsc = (uint32_t)rte_rdtsc();
+        udpdk_mbuf_trace(pkt)->sockfd = sockfd;
+    }
+
+    // Tell the poller to hold the packet until its launch time
+    if (launch_tsc != 0) {
+        pkt->ol_flags |= udpdk_txtime_flag;
+        *udpdk_mbuf_txtime(pkt) = launch_tsc;
+    }
+
+    // Fragment here if this thread has its own pools, so that the poller only forwards the fragments
+    if (!gso && pkt->pkt_len > config.mtu + RTE_ETHER_HDR_LEN && udpdk_frag_pools_get(&direct_pool, &indirect_pool) == 0) {
+        return sendto_fragmented(sockfd, pkt, len, direct_pool, indirect_pool);
+    }
 
     // Put the packet in the tx_ring
-    if (rte_ring_enqueue(exch_slots[sockfd].tx_q, (void *)pkt) < 0) {
+    if (rte_ring_enqueue(exch_zone_desc->slots[sockfd].tx_q, (void *)pkt) < 0) {
         RTE_LOG(ERR, SYSCALL, "Sendto failed to put packet in the TX ring\n  Total: %d  Free: %d\n",
-                rte_ring_count(exch_slots[sockfd].tx_q), rte_ring_free_count(exch_slots[sockfd].tx_q));
+                rte_ring_count(exch_zone_desc->slots[sockfd].tx_q), rte_ring_free_count(exch_zone_desc->slots[sockfd].tx_q));
+        exch_zone_desc->slots[sockfd].stats.tx_dropped++;
         errno = ENOBUFS;
         rte_pktmbuf_free(pkt);
         return -1;
     }
+    exch_zone_desc->slots[sockfd].stats.tx_enqueued++;
 
     return len;
 }
 
+ssize_t udpdk_sendto(int sockfd, const void *buf, size_t len, int flags,
+                     const struct sockaddr *dest_addr, socklen_t addrlen)
+{
+    struct iovec iov = {.iov_base = (void *)buf, .iov_len = len};
+
+    // Validate the arguments
+    if (sendto_validate_args(sockfd, buf, len, flags, dest_addr, addrlen) < 0) {
+        return -1;
+    }
+    return send_datagram(sockfd, &iov, 1, len, (const struct sockaddr_in *)dest_addr, 0);
+}
+
+/* Read the launch time of a send (SCM_TXTIME) from the control messages, as a TSC (0 if there is none) */
+static int sendmsg_get_txtime(int sockfd, const struct msghdr *msg, uint64_t *launch_tsc)
+{
+    struct cmsghdr *cmsg;
+    uint64_t txtime_ns;
+
+    *launch_tsc = 0;
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR((struct msghdr *)msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TXTIME) {
+            continue;
+        }
+        if (cmsg->cmsg_len != CMSG_LEN(sizeof(uint64_t)) || !exch_zone_desc->slots[sockfd].txtime) {
+            errno = EINVAL;
+            return -1;
+        }
+        memcpy(&txtime_ns, CMSG_DATA(cmsg), sizeof(txtime_ns));
+        *launch_tsc = udpdk_txtime_to_tsc(exch_zone_desc->slots[sockfd].txtime_clockid, txtime_ns);
+    }
+    return 0;
+}
+
+ssize_t udpdk_sendmsg(int sockfd, const struct msghdr *msg, int flags)
+{
+    uint64_t launch_tsc;
+    size_t len = 0;
+    size_t j;
+
+    // The message header and the scatter list must be present
+    if (msg == NULL || (msg->msg_iov == NULL && msg->msg_iovlen > 0)) {
+        errno = EFAULT;
+        return -1;
+    }
+    for (j = 0; j < msg->msg_iovlen; j++) {
+        len += msg->msg_iov[j].iov_len;
+    }
+    // Validate the arguments
+    if (sendto_validate_args(sockfd, NULL, len, flags, msg->msg_name, msg->msg_namelen) < 0) {
+        return -1;
+    }
+    if (sendmsg_get_txtime(sockfd, msg, &launch_tsc) < 0) {
+        return -1;
+    }
+    return send_datagram(sockfd, msg->msg_iov, msg->msg_iovlen, len,
+            (const struct sockaddr_in *)msg->msg_name, launch_tsc);
+}
+
 static int recvfrom_validate_args(int sockfd, void *buf, size_t len, int flags,
                                   struct sockaddr *src_addr, socklen_t *addrlen)
 {
@@ -398,22 +1148,176 @@ static int recvfrom_validate_args(int sockfd, void *buf, size_t len, int flags,
     return 0;
 }
 
-ssize_t udpdk_recvfrom(int sockfd, void *buf, size_t len, int flags,
-                       struct sockaddr *src_addr, socklen_t *addrlen)
+/* Dequeue one packet from the RX ring of a socket (busy wait until one is available) */
+static struct rte_mbuf *recv_dequeue(int sockfd)
 {
     int ret = -1;
     struct rte_mbuf *pkt = NULL;
-    struct rte_mbuf *seg = NULL;
-    uint32_t seg_len;           // number of bytes of payload in this segment
-    uint32_t eff_len;           // number of bytes to read from this segment
+
+    while (ret < 0 && !interrupted) {
+        ret = rte_ring_dequeue(exch_zone_desc->slots[sockfd].rx_q, (void **)&pkt);
+    }
+    if (ret < 0) {
+        RTE_LOG(INFO, SYSCALL, "Recv returning due to signal\n");
+        errno = EINTR;
+        return NULL;
+    }
+
+    // Account how long the packet waited in the RX ring
+    if (udpdk_trace_enabled()) {
+        udpdk_lat_record(&exch_zone_desc->slots[sockfd].latency[UDPDK_LAT_RX_QUEUE],
+                udpdk_trace_elapsed(udpdk_mbuf_trace(pkt), rte_rdtsc()));
+    }
+    return pkt;
+}
+
+/* Write the source address of a packet (or part of it if addrlen is too short) */
+static void recv_src_addr(const struct rte_ipv4_hdr *ip_hdr, const struct rte_udp_hdr *udp_hdr,
+                          struct sockaddr *src_addr, socklen_t *addrlen)
+{
+    struct sockaddr_in addr_in;
     uint32_t eff_addrlen;
-    uint32_t bytes_left = len;
-    uint16_t dgram_payl_len;    // UDP payload len, inferred from UDP header
-    unsigned nb_segs;
-    unsigned offset_payload;
-    struct rte_ether_hdr *eth_hdr;
+
+    memset(&addr_in, 0, sizeof(addr_in));
+    addr_in.sin_family = AF_INET;
+    addr_in.sin_port = udp_hdr->src_port;
+    addr_in.sin_addr.s_addr = ip_hdr->src_addr;
+    if (sizeof(addr_in) <= *addrlen) {
+        eff_addrlen = sizeof(addr_in);
+    } else {
+        eff_addrlen = *addrlen;
+    }
+    rte_memcpy((void *)src_addr, &addr_in, eff_addrlen);
+    *addrlen = eff_addrlen;
+}
+
+/* Copy the UDP payload of a packet (possibly made of multiple segments) into a scatter list */
+static size_t recv_copy_payload(struct rte_mbuf *pkt, uint16_t dgram_payl_len,
+                                const struct iovec *iov, size_t iovlen)
+{
+    struct rte_mbuf *seg = pkt;
+    uint32_t seg_off;           // offset of the next byte to read in this segment
+    uint32_t seg_len;           // number of bytes of payload left in this segment
+    uint32_t payl_left = dgram_payl_len;
+    size_t iov_idx = 0;
+    size_t iov_off = 0;
+    size_t eff_len;
+    size_t copied = 0;
+
+    // The first segment includes eth + ipv4 + udp headers before the payload
+    seg_off = sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr);
+    while (seg != NULL && payl_left > 0 && iov_idx < iovlen) {
+        // Find how many bytes of data are left in this segment (for very small packets,
+        // Ethernet payload is padded to 46 bytes, so never read beyond the UDP length)
+        seg_len = RTE_MIN((uint32_t)(seg->data_len - seg_off), payl_left);
+        if (seg_len == 0) {
+            seg = seg->next;
+            seg_off = 0;
+            continue;
+        }
+        if (iov_off == iov[iov_idx].iov_len) {
+            iov_idx++;
+            iov_off = 0;
+            continue;
+        }
+        // The amount of data to copy is the minimum between what is left in the segment and in the buffer
+        eff_len = RTE_MIN((size_t)seg_len, iov[iov_idx].iov_len - iov_off);
+        rte_memcpy((char *)iov[iov_idx].iov_base + iov_off, rte_pktmbuf_mtod_offset(seg, char *, seg_off), eff_len);
+        // Adjust pointers and counters
+        seg_off += eff_len;
+        iov_off += eff_len;
+        payl_left -= eff_len;
+        copied += eff_len;
+    }
+    return copied;
+}
+
+/* Append a control message, if it fits in the buffer; return the next free header */
+static struct cmsghdr *recv_put_cmsg(struct msghdr *msg, struct cmsghdr *cmsg, size_t *used,
+                                     int level, int type, const void *data, size_t len)
+{
+    if (cmsg == NULL || *used + CMSG_SPACE(len) > msg->msg_controllen) {
+        msg->msg_flags |= MSG_CTRUNC;
+        return NULL;
+    }
+    cmsg->cmsg_level = level;
+    cmsg->cmsg_type = type;
+    cmsg->cmsg_len = CMSG_LEN(len);
+    rte_memcpy(CMSG_DATA(cmsg), data, len);
+    *used += CMSG_SPACE(len);
+    return CMSG_NXTHDR(msg, cmsg);
+}
+
+/* Add the RX timestamps requested by the socket to the control messages of a datagram */
+static struct cmsghdr *recv_put_tstamps(int sockfd, struct rte_mbuf *pkt, struct msghdr *msg,
+                                        struct cmsghdr *cmsg, size_t *used)
+{
+    struct exch_slot_info *slot = &exch_zone_desc->slots[sockfd];
+    struct scm_timestamping tss;
+    struct timespec ts_sw;
+    bool want_sw, want_hw;
+
+    want_sw = (slot->tstamp_flags & SOF_TIMESTAMPING_SOFTWARE)
+            && (slot->tstamp_flags & SOF_TIMESTAMPING_RX_SOFTWARE);
+    want_hw = (slot->tstamp_flags & SOF_TIMESTAMPING_RAW_HARDWARE)
+            && (slot->tstamp_flags & SOF_TIMESTAMPING_RX_HARDWARE);
+
+    if (udpdk_tstamp_enabled() && (slot->tstamp_ns || want_sw || want_hw)) {
+        udpdk_tsc_to_timespec(*udpdk_mbuf_rx_tsc(pkt), &ts_sw);
+        if (slot->tstamp_ns) {
+            cmsg = recv_put_cmsg(msg, cmsg, used, SOL_SOCKET, SCM_TIMESTAMPNS, &ts_sw, sizeof(ts_sw));
+        }
+        if (want_sw || want_hw) {
+            // As in Linux: ts[0] is the software timestamp, ts[2] the raw hardware one (zero if missing)
+            memset(&tss, 0, sizeof(tss));
+            if (want_sw) {
+                tss.ts[0] = ts_sw;
+            }
+            if (want_hw && (pkt->ol_flags & PKT_RX_TIMESTAMP) && udpdk_clock_hw_enabled()) {
+                udpdk_hw_to_timespec(pkt->timestamp, &tss.ts[2]);
+            }
+            cmsg = recv_put_cmsg(msg, cmsg, used, SOL_SOCKET, SCM_TIMESTAMPING, &tss, sizeof(tss));
+        }
+    }
+    return cmsg;
+}
+
+/* Fill the control messages of a datagram (timestamps, RX drops, segment size of coalesced datagrams) */
+static void recv_put_ctrl(int sockfd, struct rte_mbuf *pkt, struct msghdr *msg)
+{
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+    size_t used = 0;
+    uint32_t drops;
+    int seg_size;
+
+    cmsg = recv_put_tstamps(sockfd, pkt, msg, cmsg, &used);
+
+    // As in Linux, the packets dropped so far by the socket are reported only once there are some
+    // (counted when the datagram is received by the app, not when it was queued)
+    if (exch_zone_desc->slots[sockfd].rxq_ovfl) {
+        drops = (uint32_t)exch_zone_desc->slots[sockfd].stats.rx_dropped_full;
+        if (drops != 0) {
+            cmsg = recv_put_cmsg(msg, cmsg, &used, SOL_SOCKET, SO_RXQ_OVFL, &drops, sizeof(drops));
+        }
+    }
+
+    // As in Linux, the segment size is reported only if the datagram was coalesced
+    if (exch_zone_desc->slots[sockfd].gro && pkt->tso_segsz != 0) {
+        seg_size = pkt->tso_segsz;
+        cmsg = recv_put_cmsg(msg, cmsg, &used, SOL_UDP, UDP_GRO, &seg_size, sizeof(seg_size));
+    }
+    msg->msg_controllen = used;
+}
+
+ssize_t udpdk_recvfrom(int sockfd, void *buf, size_t len, int flags,
+                       struct sockaddr *src_addr, socklen_t *addrlen)
+{
+    struct rte_mbuf *pkt;
     struct rte_ipv4_hdr *ip_hdr;
     struct rte_udp_hdr *udp_hdr;
+    uint16_t dgram_payl_len;    // UDP payload len, inferred from UDP header
+    struct iovec iov = {.iov_base = buf, .iov_len = len};
+    size_t copied;
 
     // Validate the arguments
     if (recvfrom_validate_args(sockfd, buf, len, flags, src_addr, addrlen) < 0) {
@@ -421,70 +1325,102 @@ ssize_t udpdk_recvfrom(int sockfd, void *buf, size_t len, int flags,
     }
 
     // Dequeue one packet (busy wait until one is available)
-    while (ret < 0 && !interrupted) {
-        ret = rte_ring_dequeue(exch_slots[sockfd].rx_q, (void **)&pkt);
-    }
-    if (interrupted) {
-        RTE_LOG(INFO, SYSCALL, "Recvfrom returning due to signal\n");
-        errno = EINTR;
+    pkt = recv_dequeue(sockfd);
+    if (pkt == NULL) {
         return -1;
     }
 
     // Get some useful pointers to headers and data
-    nb_segs = pkt->nb_segs;
-    eth_hdr = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
-    ip_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+    ip_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
     udp_hdr = (struct rte_udp_hdr *)(ip_hdr + 1);
     dgram_payl_len = rte_be_to_cpu_16(udp_hdr->dgram_len) - sizeof(struct rte_udp_hdr);
 
-    // Write source address (or part of it if addrlen is too short)
+    // Write source address
     if (src_addr != NULL) {
-        struct sockaddr_in addr_in;
-        memset(&addr_in, 0, sizeof(addr_in));
-        addr_in.sin_family = AF_INET;
-        addr_in.sin_port = udp_hdr->src_port;
-        addr_in.sin_addr.s_addr = ip_hdr->src_addr;
-        if (sizeof(addr_in) <= *addrlen) {
-            eff_addrlen = sizeof(addr_in);
-        } else {
-            eff_addrlen = *addrlen;
-        }
-        rte_memcpy((void *)src_addr, &addr_in, eff_addrlen);
-        *addrlen = eff_addrlen;
-    }
-
-    seg = pkt;
-    for (int s = 0; s < nb_segs; s++) {
-        // The the first segment includes eth + ipv4 + udp headers before the payload
-        offset_payload = (s == 0) ?
-                sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr) : 0;
-        // Find how many bytes of data are in this segment
-        seg_len = seg->data_len - offset_payload;
-        if ((s == 0) && (seg_len > dgram_payl_len)) {
-            // for very small packets, Ethernet payload is padded to 46 bytes
-            seg_len = dgram_payl_len;
-        }
-        // The amount of data to copy is the minimum between this segment length and the remaining requested bytes
-        if (seg_len < bytes_left) {
-            eff_len = seg_len;
-        } else {
-            eff_len = bytes_left;
-        }
-        // Copy payload into buffer
-        rte_memcpy(buf, rte_pktmbuf_mtod(seg, void *) + offset_payload, eff_len);
-        // Adjust pointers and counters
-        buf += eff_len;
-        bytes_left -= eff_len;
-        seg = seg->next;
-        if (bytes_left == 0) {
-            break;
-        }
+        recv_src_addr(ip_hdr, udp_hdr, src_addr, addrlen);
     }
+
+    // Copy the payload into the buffer
+    copied = recv_copy_payload(pkt, dgram_payl_len, &iov, 1);
+
     // Free the mbuf (with all the chained segments)
     rte_pktmbuf_free(pkt);
 
     // Return how many bytes read
-    return len - bytes_left;
+    return copied;
+}
+
+static int recvmsg_validate_args(int sockfd, struct msghdr *msg, int flags)
+{
+    // Ensure sockfd is not beyond max limit
+    if (sockfd < 0 || sockfd >= NUM_SOCKETS_MAX) {
+        errno = ENOTSOCK;
+        return -1;
+    }
+
+    // Check if the sockfd is valid
+    if (!exch_zone_desc->slots[sockfd].used) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Check if flags are supported (atm none is supported)
+    if (flags != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // The message header and the scatter list must be present
+    if (msg == NULL || (msg->msg_iov == NULL && msg->msg_iovlen > 0)) {
+        errno = EFAULT;
+        return -1;
+    }
+    return 0;
+}
+
+ssize_t udpdk_recvmsg(int sockfd, struct msghdr *msg, int flags)
+{
+    struct rte_mbuf *pkt;
+    struct rte_ipv4_hdr *ip_hdr;
+    struct rte_udp_hdr *udp_hdr;
+    uint16_t dgram_payl_len;    // UDP payload len, inferred from UDP header
+    size_t copied;
+
+    // Validate the arguments
+    if (recvmsg_validate_args(sockfd, msg, flags) < 0) {
+        return -1;
+    }
+
+    // Dequeue one packet (busy wait until one is available)
+    pkt = recv_dequeue(sockfd);
+    if (pkt == NULL) {
+        return -1;
+    }
+    msg->msg_flags = 0;
+
+    // Get some useful pointers to headers and data
+    ip_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+    udp_hdr = (struct rte_udp_hdr *)(ip_hdr + 1);
+    dgram_payl_len = rte_be_to_cpu_16(udp_hdr->dgram_len) - sizeof(struct rte_udp_hdr);
+
+    // Write source address
+    if (msg->msg_name != NULL) {
+        recv_src_addr(ip_hdr, udp_hdr, msg->msg_name, &msg->msg_namelen);
+    }
+
+    // Scatter the payload into the buffers, and report if it did not fit
+    copied = recv_copy_payload(pkt, dgram_payl_len, msg->msg_iov, msg->msg_iovlen);
+    if (copied < dgram_payl_len) {
+        msg->msg_flags |= MSG_TRUNC;
+    }
+
+    // Attach the timestamps and the segment size as control messages
+    recv_put_ctrl(sockfd, pkt, msg);
+
+    // Free the mbuf (with all the chained segments)
+    rte_pktmbuf_free(pkt);
+
+    return copied;
 }
 
 static int close_validate_args(int s)
@@ -505,15 +1441,33 @@ int udpdk_close(int s)
         return -1;
     }
 
-    // Unbind
+    // Unbind, and wait until the poller no longer uses the rings of the socket
     if (exch_zone_desc->slots[s].bound) {
         btable_del_binding(s, exch_zone_desc->slots[s].udp_port);
     }
+    __atomic_store_n(&exch_zone_desc->slots[s].bound, 0, __ATOMIC_SEQ_CST);
+    wait_poller_quiescent();
 
     // Reset slot
-    exch_zone_desc->slots[s].bound = 0;
-    exch_zone_desc->slots[s].used = 0;
     exch_zone_desc->slots[s].so_options = 0;
+    exch_zone_desc->slots[s].rxq_policy = UDPDK_RXQ_DROP_TAIL;
+    exch_zone_desc->slots[s].tstamp_flags = 0;
+    exch_zone_desc->slots[s].tstamp_ns = 0;
+    exch_zone_desc->slots[s].no_check = 0;
+    exch_zone_desc->slots[s].rxq_ovfl = 0;
+    exch_zone_desc->slots[s].gso_size = 0;
+    exch_zone_desc->slots[s].gro = 0;
+    exch_zone_desc->slots[s].tx_weight = TX_WEIGHT_DEFAULT;
+    exch_zone_desc->slots[s].txtime = 0;
+    set_priority(s, 0);
+    set_tx_rate(s, &(struct udpdk_tx_rate){0});
+
+    // Release the RX and TX rings (and the packets still queued)
+    exch_ring_destroy(s, EXCH_RING_RX);
+    exch_ring_destroy(s, EXCH_RING_TX);
+
+    // Free the slot last, so that no new socket takes it meanwhile
+    __atomic_store_n(&exch_zone_desc->slots[s].used, 0, __ATOMIC_RELEASE);
 
     // Decrement counter of active slots
     exch_zone_desc->n_zones_active++;
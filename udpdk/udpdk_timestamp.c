@@ -0,0 +1,193 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+
+#include <time.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
+#include <rte_ethdev.h>
+#include <rte_log.h>
+#include <rte_pause.h>
+#include <rte_spinlock.h>
+
+#include "udpdk_constants.h"
+#include "udpdk_timestamp.h"
+
+#define RTE_LOGTYPE_TSTAMP RTE_LOGTYPE_USER1
+
+/* Anchor of the TSC and of the NIC clock to CLOCK_REALTIME, moved at every resync */
+struct clock_anchor {
+    uint64_t tsc_base;          // TSC at the last resync
+    uint64_t tsc_real_ns;       // CLOCK_REALTIME at tsc_base
+    double hw_hz;               // estimated frequency of the NIC clock
+    uint64_t hw_base;           // NIC clock at the last resync
+    uint64_t hw_real_ns;        // CLOCK_REALTIME at hw_base
+};
+
+/* Mapping of the TSC and of the NIC clock to CLOCK_REALTIME (app process only). Any receiving thread may
+ * resync it: the one holding resync_lock writes the anchor, and the readers retry while seq is odd or moved */
+static struct {
+    uint64_t tsc_hz;
+    uint64_t resync_cycles;     // TSC cycles between two resyncs
+    bool hw;                    // NIC timestamps enabled
+    uint16_t port_id;           // port whose clock stamps the packets
+    rte_spinlock_t resync_lock;
+    uint32_t seq;               // odd while the anchor is being written
+    struct clock_anchor anchor;
+} clk = {
+    .resync_lock = RTE_SPINLOCK_INITIALIZER,
+};
+
+static inline uint64_t realtime_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+static inline void ns_to_timespec(uint64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / NS_PER_S;
+    ts->tv_nsec = ns % NS_PER_S;
+}
+
+/* Take a consistent copy of the anchor of the clocks */
+static inline void clock_read_anchor(struct clock_anchor *a)
+{
+    uint32_t seq;
+
+    while (1) {
+        seq = __atomic_load_n(&clk.seq, __ATOMIC_ACQUIRE);
+        if (unlikely(seq & 1)) {
+            rte_pause();
+            continue;
+        }
+        *a = clk.anchor;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (likely(__atomic_load_n(&clk.seq, __ATOMIC_RELAXED) == seq)) {
+            return;
+        }
+    }
+}
+
+/* Re-anchor the clocks to CLOCK_REALTIME (to follow NTP adjustments and the drift of the NIC clock),
+ * unless another thread is doing it */
+static void clock_resync(void)
+{
+    struct clock_anchor a;
+    uint64_t hw_now, real_now;
+
+    if (!rte_spinlock_trylock(&clk.resync_lock)) {
+        return;
+    }
+    // Only the holder of the lock writes the anchor, so it can read it as is
+    a = clk.anchor;
+    if (clk.hw && rte_eth_read_clock(clk.port_id, &hw_now) == 0) {
+        real_now = realtime_ns();
+        // Refine the frequency estimate over the last period
+        if (hw_now > a.hw_base && real_now > a.hw_real_ns) {
+            a.hw_hz = (double)(hw_now - a.hw_base) * NS_PER_S / (real_now - a.hw_real_ns);
+        }
+        a.hw_base = hw_now;
+        a.hw_real_ns = real_now;
+    }
+    a.tsc_base = rte_rdtsc();
+    a.tsc_real_ns = realtime_ns();
+
+    __atomic_store_n(&clk.seq, clk.seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    clk.anchor = a;
+    __atomic_store_n(&clk.seq, clk.seq + 1, __ATOMIC_RELEASE);
+    rte_spinlock_unlock(&clk.resync_lock);
+}
+
+/* Register the dynamic mbuf field holding the software timestamp (or find it, if already registered) */
+int udpdk_tstamp_init(void)
+{
+    static const struct rte_mbuf_dynfield tstamp_dynfield_desc = {
+        .name = UDPDK_TSTAMP_DYNFIELD_NAME,
+        .size = sizeof(uint64_t),
+        .align = __alignof__(uint64_t),
+    };
+
+    udpdk_tstamp_offset = rte_mbuf_dynfield_register(&tstamp_dynfield_desc);
+    if (udpdk_tstamp_offset < 0) {
+        RTE_LOG(ERR, TSTAMP, "Cannot register the mbuf field for RX timestamps: %s\n",
+                rte_strerror(rte_errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Calibrate the conversion of TSC (and NIC clock, if used) to CLOCK_REALTIME */
+int udpdk_clock_init(uint16_t port_id, bool hw_tstamp)
+{
+    uint64_t hw_start, real_start;
+
+    clk.tsc_hz = rte_get_tsc_hz();
+    clk.resync_cycles = clk.tsc_hz / MS_PER_S * UDPDK_CLOCK_RESYNC_MS;
+    clk.port_id = port_id;
+    clk.hw = false;
+
+    if (hw_tstamp) {
+        // Estimate the frequency of the NIC clock against CLOCK_REALTIME
+        if (rte_eth_read_clock(port_id, &hw_start) != 0) {
+            RTE_LOG(WARNING, TSTAMP, "Cannot read the clock of port %d, using software timestamps\n", port_id);
+        } else {
+            real_start = realtime_ns();
+            rte_delay_ms(UDPDK_CLOCK_CALIB_MS);
+            // No receiving thread exists yet, so the anchor can be written directly
+            if (rte_eth_read_clock(port_id, &clk.anchor.hw_base) == 0 && clk.anchor.hw_base > hw_start) {
+                clk.anchor.hw_real_ns = realtime_ns();
+                clk.anchor.hw_hz = (double)(clk.anchor.hw_base - hw_start) * NS_PER_S
+                        / (clk.anchor.hw_real_ns - real_start);
+                clk.hw = true;
+                RTE_LOG(INFO, TSTAMP, "Clock of port %d runs at %.0f Hz\n", port_id, clk.anchor.hw_hz);
+            } else {
+                RTE_LOG(WARNING, TSTAMP, "Clock of port %d is not running, using software timestamps\n", port_id);
+            }
+        }
+    }
+    clock_resync();
+    return 0;
+}
+
+/* Whether the received packets carry a NIC timestamp */
+bool udpdk_clock_hw_enabled(void)
+{
+    return clk.hw;
+}
+
+/* Convert a TSC value (taken in any process) to CLOCK_REALTIME */
+void udpdk_tsc_to_timespec(uint64_t tsc, struct timespec *ts)
+{
+    struct clock_anchor a;
+    int64_t delta;
+
+    clock_read_anchor(&a);
+    if (unlikely(rte_rdtsc() - a.tsc_base > clk.resync_cycles)) {
+        clock_resync();
+        clock_read_anchor(&a);
+    }
+    delta = (int64_t)(tsc - a.tsc_base);
+    ns_to_timespec(a.tsc_real_ns + (int64_t)((double)delta * NS_PER_S / clk.tsc_hz), ts);
+}
+
+/* Convert a timestamp of the NIC clock to CLOCK_REALTIME */
+void udpdk_hw_to_timespec(uint64_t ticks, struct timespec *ts)
+{
+    struct clock_anchor a;
+    int64_t delta;
+
+    clock_read_anchor(&a);
+    if (unlikely(rte_rdtsc() - a.tsc_base > clk.resync_cycles)) {
+        clock_resync();
+        clock_read_anchor(&a);
+    }
+    delta = (int64_t)(ticks - a.hw_base);
+    ns_to_timespec(a.hw_real_ns + (int64_t)((double)delta * NS_PER_S / a.hw_hz), ts);
+}
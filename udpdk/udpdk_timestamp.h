@@ -0,0 +1,43 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+// RX timestamps: the poller stamps each received packet with the TSC (in a
+// dynamic mbuf field), the NIC may add its own clock (mbuf->timestamp), and
+// the app converts both to CLOCK_REALTIME when delivering the datagram
+//
+
+#ifndef UDPDK_TIMESTAMP_H
+#define UDPDK_TIMESTAMP_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include <rte_branch_prediction.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_dyn.h>
+
+/* Offset of the software timestamp in the mbufs (negative if RX timestamps are disabled) */
+extern int udpdk_tstamp_offset;
+
+static inline int udpdk_tstamp_enabled(void)
+{
+    return unlikely(udpdk_tstamp_offset >= 0);
+}
+
+static inline uint64_t *udpdk_mbuf_rx_tsc(struct rte_mbuf *m)
+{
+    return RTE_MBUF_DYNFIELD(m, udpdk_tstamp_offset, uint64_t *);
+}
+
+int udpdk_tstamp_init(void);
+
+int udpdk_clock_init(uint16_t port_id, bool hw_tstamp);
+
+bool udpdk_clock_hw_enabled(void);
+
+void udpdk_tsc_to_timespec(uint64_t tsc, struct timespec *ts);
+
+void udpdk_hw_to_timespec(uint64_t ticks, struct timespec *ts);
+
+#endif  // UDPDK_TIMESTAMP_H
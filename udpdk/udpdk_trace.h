@@ -0,0 +1,65 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+// Per-packet latency tracing: packets are stamped with the TSC in a dynamic
+// mbuf field as they move between NIC, poller, socket rings and app, and the
+// time spent in each stage is accumulated in per-socket histograms
+//
+
+#ifndef UDPDK_TRACE_H
+#define UDPDK_TRACE_H
+
+#include <rte_branch_prediction.h>
+#include <rte_common.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_dyn.h>
+
+#include "udpdk_types.h"
+
+/* Offset of the trace field in the mbufs (negative if tracing is disabled) */
+extern int udpdk_trace_offset;
+
+/*
+ * Trace stamp of a packet, kept to 8 bytes as DPDK 20.05 has only 16 bytes of dynamic fields (shared with the
+ * RX timestamp). Only the start of the current stage is needed, as each stage is accounted when it ends:
+ *   RX: returned by rte_eth_rx_burst(), then enqueued in the socket RX ring
+ *   TX: enqueued by udpdk_sendto(), then dequeued by the poller
+ */
+struct udpdk_mbuf_trace {
+    uint32_t tsc;       // low 32 bits of the TSC at the start of the current stage
+    int sockfd;         // TX: socket that sent the packet (-1 if not to be accounted)
+};
+
+static inline int udpdk_trace_enabled(void)
+{
+    return unlikely(udpdk_trace_offset >= 0);
+}
+
+static inline struct udpdk_mbuf_trace *udpdk_mbuf_trace(struct rte_mbuf *m)
+{
+    return RTE_MBUF_DYNFIELD(m, udpdk_trace_offset, struct udpdk_mbuf_trace *);
+}
+
+/* Cycles elapsed since the start of the current stage of a packet (modulo 2^32, about a second) */
+static inline uint32_t udpdk_trace_elapsed(const struct udpdk_mbuf_trace *t, uint64_t now)
+{
+    return (uint32_t)now - t->tsc;
+}
+
+/* Account a latency sample in a histogram */
+static inline void udpdk_lat_record(struct udpdk_lat_hist *h, uint64_t cycles)
+{
+    unsigned b = 63 - __builtin_clzll(cycles | 1);
+
+    h->buckets[RTE_MIN(b, UDPDK_LAT_BUCKETS - 1)]++;
+    h->count++;
+    h->sum_cycles += cycles;
+    if (cycles > h->max_cycles) {
+        h->max_cycles = cycles;
+    }
+}
+
+int udpdk_trace_init(void);
+
+#endif  // UDPDK_TRACE_H
@@ -0,0 +1,217 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+
+#include <time.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
+#include <rte_log.h>
+
+#include "udpdk_txtime.h"
+
+#define RTE_LOGTYPE_TXTIME RTE_LOGTYPE_USER1
+
+#define TXTIME_WHEEL_MASK   (TXTIME_WHEEL_SLOTS - 1)
+
+/* Register the dynamic mbuf flag of the packets with a launch time (or find it, if already registered) */
+int udpdk_txtime_init(void)
+{
+    static const struct rte_mbuf_dynflag txtime_dynflag_desc = {
+        .name = UDPDK_TXTIME_DYNFLAG_NAME,
+    };
+    int bit;
+
+    bit = rte_mbuf_dynflag_register(&txtime_dynflag_desc);
+    if (bit < 0) {
+        RTE_LOG(ERR, TXTIME, "Cannot register the mbuf flag for launch times: %s\n", rte_strerror(rte_errno));
+        return -1;
+    }
+    udpdk_txtime_flag = 1ULL << bit;
+    return 0;
+}
+
+/* Convert a launch time in nanoseconds of the given clock (SCM_TXTIME) to the TSC; times in the past give now */
+uint64_t udpdk_txtime_to_tsc(clockid_t clockid, uint64_t txtime_ns)
+{
+    struct timespec ts;
+    uint64_t now_tsc, now_ns, delta_ns, hz;
+
+    clock_gettime(clockid, &ts);
+    now_tsc = rte_rdtsc();
+    now_ns = (uint64_t)ts.tv_sec * NS_PER_S + ts.tv_nsec;
+    if (txtime_ns <= now_ns) {
+        return now_tsc;
+    }
+    // Split seconds and nanoseconds, not to overflow with launch times seconds away
+    delta_ns = txtime_ns - now_ns;
+    hz = rte_get_tsc_hz();
+    return now_tsc + delta_ns / NS_PER_S * hz + delta_ns % NS_PER_S * hz / NS_PER_S;
+}
+
+static inline void list_init(struct txtime_list *list)
+{
+    list->head = list->tail = TXTIME_NODE_NONE;
+}
+
+static inline void list_append(struct txtime_wheel *w, struct txtime_list *list, uint32_t n)
+{
+    w->nodes[n].next = TXTIME_NODE_NONE;
+    if (list->tail == TXTIME_NODE_NONE) {
+        list->head = n;
+    } else {
+        w->nodes[list->tail].next = n;
+    }
+    list->tail = n;
+}
+
+/* Move all the packets of src at the end of dst */
+static inline void list_splice(struct txtime_wheel *w, struct txtime_list *dst, struct txtime_list *src)
+{
+    if (src->head == TXTIME_NODE_NONE) {
+        return;
+    }
+    if (dst->tail == TXTIME_NODE_NONE) {
+        dst->head = src->head;
+    } else {
+        w->nodes[dst->tail].next = src->head;
+    }
+    dst->tail = src->tail;
+    list_init(src);
+}
+
+/* First tick from which a packet can be sent (never before its launch time) */
+static inline uint64_t txtime_tick(const struct txtime_wheel *w, uint64_t tsc)
+{
+    return (tsc + w->tick_cycles - 1) / w->tick_cycles;
+}
+
+/* Put a packet in the slot of its tick, in the level of the first digit that differs from the current tick */
+static void wheel_insert(struct txtime_wheel *w, uint32_t n, uint64_t tick)
+{
+    uint64_t diff = tick ^ w->now;
+    unsigned level;
+
+    if (tick <= w->now) {
+        list_append(w, &w->due, n);
+    } else if (diff >> (TXTIME_WHEEL_BITS * TXTIME_WHEEL_LEVELS)) {
+        // Beyond the current rotation of the top level
+        list_append(w, &w->overflow, n);
+    } else {
+        level = (63 - __builtin_clzll(diff)) / TXTIME_WHEEL_BITS;
+        list_append(w, &w->slots[level][(tick >> (TXTIME_WHEEL_BITS * level)) & TXTIME_WHEEL_MASK], n);
+    }
+}
+
+/* Insert again the packets of a list, which now belong to lower levels */
+static void wheel_cascade(struct txtime_wheel *w, struct txtime_list *list)
+{
+    uint32_t n = list->head;
+    uint32_t next;
+
+    list_init(list);
+    while (n != TXTIME_NODE_NONE) {
+        next = w->nodes[n].next;
+        wheel_insert(w, n, txtime_tick(w, w->nodes[n].tsc));
+        n = next;
+    }
+}
+
+/* Move to the next tick */
+static void wheel_tick(struct txtime_wheel *w)
+{
+    uint64_t t = ++w->now;
+    int level;
+
+    // At the start of a rotation of a level, spread the packets of its slot over the lower levels
+    // (from the top, as a packet may cascade more than once)
+    if ((t & (TXTIME_WHEEL_HORIZON - 1)) == 0) {
+        wheel_cascade(w, &w->overflow);
+    }
+    for (level = TXTIME_WHEEL_LEVELS - 1; level > 0; level--) {
+        if ((t & ((1ULL << (TXTIME_WHEEL_BITS * level)) - 1)) == 0) {
+            wheel_cascade(w, &w->slots[level][(t >> (TXTIME_WHEEL_BITS * level)) & TXTIME_WHEEL_MASK]);
+        }
+    }
+    list_splice(w, &w->due, &w->slots[0][t & TXTIME_WHEEL_MASK]);
+}
+
+/* Initialize an empty timer wheel */
+void txtime_wheel_init(struct txtime_wheel *w, uint64_t tick_cycles, uint64_t now_tsc)
+{
+    unsigned level, slot;
+    uint32_t n;
+
+    w->tick_cycles = tick_cycles;
+    w->now = now_tsc / tick_cycles;
+    w->n_pkts = 0;
+    list_init(&w->due);
+    list_init(&w->overflow);
+    for (level = 0; level < TXTIME_WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < TXTIME_WHEEL_SLOTS; slot++) {
+            list_init(&w->slots[level][slot]);
+        }
+    }
+    for (n = 0; n < TXTIME_WHEEL_MAX_PKTS; n++) {
+        w->nodes[n].next = (n + 1 < TXTIME_WHEEL_MAX_PKTS) ? n + 1 : TXTIME_NODE_NONE;
+    }
+    w->free = 0;
+}
+
+/* Hold a packet of a socket until its launch time; return 1 if held, 0 if it is already due (the caller
+ * sends it), -1 if the wheel is full */
+int txtime_wheel_add(struct txtime_wheel *w, struct rte_mbuf *m, int sockfd)
+{
+    uint64_t tsc = *udpdk_mbuf_txtime(m);
+    uint64_t tick = txtime_tick(w, tsc);
+    uint32_t n;
+
+    if (tick <= w->now) {
+        return 0;
+    }
+    n = w->free;
+    if (unlikely(n == TXTIME_NODE_NONE)) {
+        return -1;
+    }
+    w->free = w->nodes[n].next;
+    w->nodes[n].m = m;
+    w->nodes[n].tsc = tsc;
+    w->nodes[n].sockfd = sockfd;
+    wheel_insert(w, n, tick);
+    w->n_pkts++;
+    return 1;
+}
+
+/* Advance the wheel to the current time, and return up to max packets whose launch time has come,
+ * with the sockets that sent them */
+uint16_t txtime_wheel_advance(struct txtime_wheel *w, uint64_t now_tsc, struct rte_mbuf **pkts, int *sockfds,
+        uint16_t max)
+{
+    uint64_t target = now_tsc / w->tick_cycles;
+    uint32_t node;
+    uint16_t n = 0;
+
+    if (w->n_pkts == 0) {
+        w->now = RTE_MAX(w->now, target);
+        return 0;
+    }
+    while (w->now < target) {
+        wheel_tick(w);
+    }
+    while (n < max && (node = w->due.head) != TXTIME_NODE_NONE) {
+        w->due.head = w->nodes[node].next;
+        pkts[n] = w->nodes[node].m;
+        sockfds[n] = w->nodes[node].sockfd;
+        n++;
+        // Give the node back
+        w->nodes[node].next = w->free;
+        w->free = node;
+    }
+    if (w->due.head == TXTIME_NODE_NONE) {
+        w->due.tail = TXTIME_NODE_NONE;
+    }
+    w->n_pkts -= n;
+    return n;
+}
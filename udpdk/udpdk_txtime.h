@@ -0,0 +1,83 @@
+//
+// Created by agent on 10/19/26.
+// Copyright (c) 2026 agent. All rights reserved.
+//
+// Scheduled transmission (SO_TXTIME): the app stamps each packet with its
+// launch time in TSC cycles (in udata64), and the poller holds the packets
+// in a hierarchical timer wheel until their tick comes
+//
+
+#ifndef UDPDK_TXTIME_H
+#define UDPDK_TXTIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <rte_branch_prediction.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_dyn.h>
+
+#include "udpdk_constants.h"
+
+#define TXTIME_WHEEL_SLOTS      (1 << TXTIME_WHEEL_BITS)
+#define TXTIME_WHEEL_HORIZON    (1ULL << (TXTIME_WHEEL_BITS * TXTIME_WHEEL_LEVELS))    // ticks of a rotation of the top level
+#define TXTIME_NODE_NONE        UINT32_MAX
+
+/* Flag of the packets with a launch time (0 if SO_TXTIME is disabled) */
+extern uint64_t udpdk_txtime_flag;
+
+static inline int udpdk_txtime_enabled(void)
+{
+    return unlikely(udpdk_txtime_flag != 0);
+}
+
+/* Launch time of a packet, in TSC cycles. It is kept in udata64, a static field in DPDK 20.05, since the
+ * 16 bytes of dynamic fields are taken by the latency trace and the RX timestamp */
+static inline uint64_t *udpdk_mbuf_txtime(struct rte_mbuf *m)
+{
+    return &m->udata64;
+}
+
+/* Packet held in the timer wheel, which is private to the poller and keeps its links out of the mbufs */
+struct txtime_node {
+    struct rte_mbuf *m;
+    uint64_t tsc;               // launch time
+    int sockfd;                 // socket that sent the packet
+    uint32_t next;              // next node in the same list, or in the free list (TXTIME_NODE_NONE if last)
+};
+
+/* List of packets in a slot of the timer wheel, in order of insertion */
+struct txtime_list {
+    uint32_t head;
+    uint32_t tail;
+};
+
+/*
+ * Hierarchical timer wheel: level l has TXTIME_WHEEL_SLOTS slots of 2^(l * TXTIME_WHEEL_BITS) ticks each.
+ * A packet goes in the level of the most significant digit in which its tick differs from the current one,
+ * and moves to the lower levels (cascades) as the current tick reaches its slot.
+ */
+struct txtime_wheel {
+    uint64_t tick_cycles;       // TSC cycles per tick
+    uint64_t now;               // last tick processed
+    uint32_t n_pkts;            // packets held (including the due ones)
+    struct txtime_list due;     // packets whose tick has come, not yet returned
+    struct txtime_list overflow;    // packets beyond the current rotation of the top level
+    struct txtime_list slots[TXTIME_WHEEL_LEVELS][TXTIME_WHEEL_SLOTS];
+    uint32_t free;              // first unused node
+    struct txtime_node nodes[TXTIME_WHEEL_MAX_PKTS];
+};
+
+int udpdk_txtime_init(void);
+
+uint64_t udpdk_txtime_to_tsc(clockid_t clockid, uint64_t txtime_ns);
+
+void txtime_wheel_init(struct txtime_wheel *w, uint64_t tick_cycles, uint64_t now_tsc);
+
+int txtime_wheel_add(struct txtime_wheel *w, struct rte_mbuf *m, int sockfd);
+
+uint16_t txtime_wheel_advance(struct txtime_wheel *w, uint64_t now_tsc, struct rte_mbuf **pkts, int *sockfds,
+        uint16_t max);
+
+#endif  // UDPDK_TXTIME_H
@@ -24,9 +24,39 @@
 
 #include "udpdk_constants.h"
 #include "udpdk_list.h"
+#include "udpdk_ratelimit.h"
 
 enum exch_ring_func {EXCH_RING_RX, EXCH_RING_TX};
 
+/* Policy applied by the poller when the RX ring of a socket is full (UDPDK_SO_RXQ_POLICY) */
+enum udpdk_rxq_policy {
+    UDPDK_RXQ_DROP_TAIL,        // drop the packets that don't fit (default)
+    UDPDK_RXQ_DROP_HEAD,        // drop the oldest packets in the ring to make room for the new ones
+    UDPDK_RXQ_BACKPRESSURE      // hold the packets and stop receiving from the NIC until the app catches up
+};
+
+/* Source of the RX timestamps (rx_timestamp in the configuration file) */
+enum udpdk_tstamp_mode {
+    UDPDK_TSTAMP_NONE,          // no timestamps (default)
+    UDPDK_TSTAMP_SOFTWARE,      // TSC read by the poller when the packet is received from the NIC
+    UDPDK_TSTAMP_HARDWARE       // NIC clock (if supported), in addition to the software one
+};
+
+/* Implementation of the parsing of RX headers (rx_parser in the configuration file) */
+enum udpdk_rx_parser {
+    UDPDK_RX_PARSER_AUTO,       // the best supported by the CPU (default)
+    UDPDK_RX_PARSER_SCALAR,     // one packet at a time
+    UDPDK_RX_PARSER_SSE42,      // 4 packets at a time
+    UDPDK_RX_PARSER_AVX2        // 8 packets at a time
+};
+
+/* When the poller sends the packets dequeued from the sockets (tx_flush in the configuration file) */
+enum udpdk_tx_flush {
+    UDPDK_TX_FLUSH_IMMEDIATE,   // at the end of every loop iteration (lowest latency, default)
+    UDPDK_TX_FLUSH_COALESCE,    // when tx_burst packets are ready, or the oldest waited tx_flush_us
+    UDPDK_TX_FLUSH_ADAPTIVE     // coalesce only while the TX rate fills a burst within tx_flush_us
+};
+
 /* Descriptor for a binding of a socket to (IP, port) */
 struct bind_info {
     int sockfd;         // socket fd of the (addr, port) pair
@@ -36,6 +66,140 @@ struct bind_info {
     bool closed;        // mark this binding as closed
 };
 
+/* Reasons why the poller drops a received packet */
+enum udpdk_drop_reason {
+    UDPDK_DROP_NOT_IPV4,        // not an IPv4 packet
+    UDPDK_DROP_NOT_UDP,         // not a UDP datagram
+    UDPDK_DROP_NO_BINDING,      // no socket bound to the destination port
+    UDPDK_DROP_NO_MATCH,        // no socket bound to the destination address on that port
+    UDPDK_DROP_NO_MBUF,         // failed to allocate an mbuf to deliver to multiple sockets
+    UDPDK_DROP_BAD_IP_CKSUM,    // wrong IPv4 header checksum
+    UDPDK_DROP_BAD_UDP_CKSUM,   // wrong UDP checksum
+    UDPDK_DROP_FRAG_SRC_CAP,    // fragment from a source that exceeded frag_max_per_src
+    UDPDK_DROP_FRAG_DISABLED,   // fragment received with reassembly disabled
+    UDPDK_DROP_REASONS
+};
+
+/* Counters of a NIC RX queue served by the poller */
+struct udpdk_rxq_stats {
+    uint64_t pkts;          // packets received
+    uint64_t bytes;         // bytes received
+    uint64_t bursts;        // non-empty bursts received
+};
+
+/* Counters of a NIC TX queue served by the poller */
+struct udpdk_txq_stats {
+    uint64_t pkts;          // packets sent
+    uint64_t bytes;         // bytes sent
+    uint64_t bursts;        // bursts sent
+    uint64_t dropped;       // packets not accepted by the NIC (queue full)
+    uint64_t flush_timeout; // bursts sent because the oldest packet waited tx_flush_us (not full)
+};
+
+/* Counters of IPv4 reassembly */
+struct udpdk_reasm_stats {
+    uint64_t reassembled;       // datagrams reassembled
+    uint64_t frags_timed_out;   // fragments freed because their datagram expired (or was invalid)
+    uint64_t frags_table_full;  // fragments dropped because the table was full (or the datagram invalid)
+};
+
+/* Counters of the scheduled transmissions (SO_TXTIME) */
+struct udpdk_txtime_stats {
+    uint64_t scheduled;     // packets held by the poller until their launch time
+    uint64_t late;          // packets dequeued by the poller after their launch time (sent at once)
+    uint64_t dropped;       // packets dropped because the timer wheel was full
+};
+
+/* Stages of the poller loop, for cycle accounting (built with UDPDK_POLLER_PROFILE) */
+enum udpdk_poller_stage {
+    UDPDK_STAGE_TX_DEQUEUE,     // dequeue from the TX rings of sockets
+    UDPDK_STAGE_TX_FRAG,        // IPv4 fragmentation of the packets to send
+    UDPDK_STAGE_TX_BURST,       // transmission to the NIC
+    UDPDK_STAGE_RX_BURST,       // reception from the NIC
+    UDPDK_STAGE_RX_PROCESS,     // parsing, reassembly and demux of the received packets
+    UDPDK_STAGE_RX_FLUSH,       // flush to the RX rings of sockets
+    UDPDK_STAGES
+};
+
+/* Cycle accounting of the poller loop (all zero unless built with UDPDK_POLLER_PROFILE) */
+struct udpdk_poller_profile {
+    uint64_t tsc_hz;                        // TSC frequency, to convert cycles to time
+    uint64_t stage_cycles[UDPDK_STAGES];    // cycles spent in each stage
+    uint64_t loops_busy;                    // iterations that sent or received something
+    uint64_t loops_empty;                   // iterations that found nothing to do
+    uint64_t cycles_busy;                   // cycles spent in busy iterations
+    uint64_t cycles_empty;                  // cycles spent in empty iterations
+};
+
+/* Counters of the poller (in shared memory, updated by the poller only) */
+struct udpdk_poller_stats {
+    struct udpdk_rxq_stats rxq[NUM_QUEUES_MAX];
+    struct udpdk_txq_stats txq[NUM_QUEUES_MAX];
+    uint64_t rx_drops[UDPDK_DROP_REASONS];  // received packets dropped, by reason
+    struct udpdk_reasm_stats reasm;
+    struct udpdk_txtime_stats txtime;
+    struct udpdk_poller_profile profile;
+};
+
+/* Snapshot of the global state of UDPDK (udpdk_get_stats) */
+struct udpdk_stats {
+    struct udpdk_poller_stats poller;   // counters of the poller
+    struct rte_eth_stats port;          // counters of the NIC port (including imissed and rx_nombuf)
+    unsigned rx_pool_in_use;            // mbufs of the RX pool in use
+    unsigned tx_pool_in_use;            // mbufs of the TX pool in use
+    unsigned n_sockets;                 // open sockets
+};
+
+/* Rate limit of the transmissions of a socket (UDPDK_SO_TX_RATE); a rate of 0 is unlimited,
+ * a burst of 0 is the default one */
+struct udpdk_tx_rate {
+    uint64_t bytes_per_sec;     // bytes per second (Ethernet frames, without preamble and CRC)
+    uint64_t pkts_per_sec;      // datagrams per second (each segment of a UDP_SEGMENT send counts as one)
+    uint32_t burst_bytes;       // bytes that can be sent back-to-back after an idle period
+    uint32_t burst_pkts;        // datagrams that can be sent back-to-back after an idle period
+};
+
+/* Counters of a socket, grouped by the process that updates them, on separate cache lines */
+struct udpdk_sock_stats {
+    // Updated by the poller
+    uint64_t rx_delivered;      // packets put in the RX ring
+    uint64_t rx_dropped_full;   // packets dropped because the RX ring was full
+    uint64_t rx_gro_merged;     // datagrams coalesced into the previous one of the same flow (UDP_GRO)
+    uint64_t tx_gso_segments;   // datagrams built by the poller from UDP_SEGMENT sends
+    uint64_t tx_throttled;      // times the poller held back a packet of the socket to respect its rate limit
+    uint64_t rx_hold_timeouts;  // times the socket held back packets (backpressure) for longer than rxq_hold_ms
+    // Updated by the app (sending threads)
+    uint64_t tx_enqueued __rte_cache_aligned;   // datagrams put in the TX ring (whole or as fragments)
+    uint64_t tx_dropped;        // datagrams dropped because the TX ring was full
+    uint64_t tx_fragmented;     // packets fragmented before transmission (also by the poller: updated atomically)
+    // Filled when read
+    uint32_t rx_queued;         // packets in the RX ring
+    uint32_t tx_queued;         // packets in the TX ring
+};
+
+/* Stages of the path of a packet, whose latency is traced (if latency_trace is enabled) */
+enum udpdk_lat_stage {
+    UDPDK_LAT_RX_POLLER,    // from rte_eth_rx_burst() to the enqueue in the socket RX ring
+    UDPDK_LAT_RX_QUEUE,     // from the enqueue in the socket RX ring to udpdk_recvfrom()
+    UDPDK_LAT_TX_QUEUE,     // from udpdk_sendto() to the dequeue by the poller
+    UDPDK_LAT_TX_POLLER,    // from the dequeue by the poller to rte_eth_tx_burst()
+    UDPDK_LAT_STAGES
+};
+
+/* Latency histogram of a stage (bucket i counts the latencies in [2^i, 2^(i+1)) cycles) */
+struct udpdk_lat_hist {
+    uint64_t count;
+    uint64_t sum_cycles;
+    uint64_t max_cycles;
+    uint64_t buckets[UDPDK_LAT_BUCKETS];
+} __rte_cache_aligned;
+
+/* Latency histograms of a socket, one per stage */
+struct udpdk_sock_latency {
+    uint64_t tsc_hz;        // TSC frequency, to convert cycles to time (filled when read)
+    struct udpdk_lat_hist stage[UDPDK_LAT_STAGES];
+};
+
 /* Descriptor of a socket (current state and options) */
 struct exch_slot_info {
     int used;       // used by an open socket
@@ -44,20 +208,48 @@ struct exch_slot_info {
     int udp_port;   // UDP port associated to the socket (only if bound)
     struct in_addr ip_addr;     // IPv4 address associated to the socket (only if bound)
     int so_options; // socket options
+    int rxq_policy; // policy when the RX ring is full (enum udpdk_rxq_policy)
+    int tstamp_flags;   // SOF_TIMESTAMPING_* flags (SO_TIMESTAMPING)
+    int tstamp_ns;      // report the software timestamp as SCM_TIMESTAMPNS (SO_TIMESTAMPNS)
+    int no_check;       // do not compute the UDP checksum of outgoing datagrams (SO_NO_CHECK)
+    int rxq_ovfl;       // report the RX drops with each datagram (SO_RXQ_OVFL)
+    int gso_size;       // split the sends into datagrams of this size, if non-zero (UDP_SEGMENT)
+    int gro;            // coalesce the received datagrams of the same flow (UDP_GRO)
+    int tx_weight;      // frames sent per round of the TX scheduler (UDPDK_SO_TX_WEIGHT)
+    int priority;       // priority of the packets of the socket (SO_PRIORITY)
+    int txtime;         // the sends can carry a launch time (SO_TXTIME)
+    int txtime_clockid; // clock of the launch times (SO_TXTIME)
+    struct udpdk_tx_rate tx_rate;   // rate limit of the transmissions (UDPDK_SO_TX_RATE)
+    uint32_t tx_rate_gen;           // incremented at every change of tx_rate, to reload the token buckets
+    struct rte_ring *rx_q;      // RX queue (created by 'socket', sized by SO_RCVBUF)
+    struct rte_ring *tx_q;      // TX queue (created by 'socket', sized by SO_SNDBUF)
+    struct udpdk_sock_stats stats __rte_cache_aligned;  // counters (read with UDPDK_SO_STATS)
+    struct udpdk_lat_hist latency[UDPDK_LAT_STAGES];    // latency histograms (if latency_trace is enabled)
 } __rte_cache_aligned;
 
 /* Descriptor of the zone in shared memory where packets are exchanged between app and poller */
 struct exch_zone_info {
     uint64_t n_zones_active;
+    uint64_t poller_epoch;      // iterations started by the poller loop (to know when it let go of a socket)
+    int poller_running;         // the poller loop is running (or may be about to start an iteration)
+    uint64_t tx_offloads;       // TX offloads enabled on the port (DEV_TX_OFFLOAD_*)
+    uint16_t txq_prio;          // NIC TX queue of the high-priority sockets (QUEUE_TX if not dedicated)
+    uint64_t prio_socks[NUM_SOCKETS_MAX / 64];  // bitmap of the high-priority sockets
     struct exch_slot_info slots[NUM_SOCKETS_MAX];
 };
 
-/* Descriptor of the exchange zone queues and buffers for a socket */
+/* Descriptor of the poller-side buffers for a socket */
 struct exch_slot {
-    struct rte_ring *rx_q;                      // RX queue
-    struct rte_ring *tx_q;                      // TX queue
     struct rte_mbuf *rx_buffer[EXCH_BUF_SIZE];  // buffers storing rx packets before flushing to rt_ring
     uint16_t rx_count;                          // current number of packets in the rx buffer
+    uint64_t rx_hold_since;                     // TSC from which the rx buffer is held back (backpressure), or 0
+    bool rx_hold_expired;                       // held back too long: drop-tail until the RX ring has room again
+    struct rte_mbuf *tx_pending;                // head of the tx ring that exceeded the deficit (sent next round)
+    uint32_t tx_deficit;                        // bytes the socket can still send in this round (DRR)
+    uint32_t tx_rate_gen;                       // generation of the rate limit loaded in the token buckets
+    bool tx_limited;                            // the socket has a rate limit
+    struct token_bucket tx_tb_bytes;            // bytes the socket can send (if limited)
+    struct token_bucket tx_tb_pkts;             // datagrams the socket can send (if limited)
 } __rte_cache_aligned;
 
 /* Global configuration (parsed from file) */
@@ -68,6 +260,28 @@ typedef struct {
     char lcores_primary[MAX_ARG_LEN];
     char lcores_secondary[MAX_ARG_LEN];
     int n_mem_channels;
+    int mtu;                // IPv4 MTU of the port (larger datagrams are fragmented)
+    int latency_trace;      // stamp packets and collect per-socket latency histograms
+    int rx_timestamp;       // source of the RX timestamps (enum udpdk_tstamp_mode)
+    int app_frag;           // app threads that fragment their own sends (0: all done by the poller)
+    int frag_buckets;       // buckets of the reassembly table
+    int frag_bucket_entries;    // entries (datagrams) per bucket of the reassembly table
+    int frag_max_entries;   // max datagrams being reassembled at once
+    int frag_ttl_ms;        // time to complete a datagram before its fragments are dropped
+    int frag_max_per_src;   // max fragments accepted from a source within frag_ttl_ms (0: unlimited)
+    int rx_parser;          // implementation of the parsing of RX headers (enum udpdk_rx_parser)
+    int rx_prefetch;        // distance (packets) between the stages of the RX prefetching (0: disabled)
+    int tx_flush;           // when the poller sends the packets dequeued from the sockets (enum udpdk_tx_flush)
+    int tx_burst;           // packets per TX burst
+    int tx_flush_us;        // max time a packet waits for its burst to fill (coalesce, adaptive)
+    int rxq_hold_ms;        // max time a socket under backpressure can stop RX, before dropping its packets
+    int tx_frag;            // fragment the datagrams larger than the MTU (otherwise they are refused)
+    int rx_reasm;           // reassemble the received fragments (otherwise they are dropped)
+    int shared_ports;       // allow multiple bindings per port (SO_REUSEADDR, SO_REUSEPORT, distinct addresses)
+    int prio_high;          // SO_PRIORITY from which a socket is served before the others
+    int prio_txq;           // send the packets of the high-priority sockets on a dedicated NIC TX queue
+    int txtime;             // allow scheduled transmissions (SO_TXTIME), held by the poller until their launch time
+    int txtime_tick_ns;     // resolution of the launch times (tick of the timer wheel of the poller)
 } configuration;
 
 #endif //UDPDK_TYPES_H